@@ -0,0 +1,166 @@
+#include "./lib/assert.h"
+
+#include "checkpoint.h"
+#include "format.h"
+
+/* Weight of the previous value when smoothing growth rate and cost, out of
+ * 4. */
+#define CHECKPOINT__SMOOTHING 3
+
+/* Deferred attempts are retried early if the WAL is expected to hit the hard
+ * bound within this time, in nanoseconds. */
+#define CHECKPOINT__HORIZON (1000 * 1000 * 1000)
+
+/* The soft target is never lowered below this fraction of the configured
+ * threshold. */
+#define CHECKPOINT__MIN_TARGET_DIVISOR 8
+
+static uint64_t smooth(uint64_t value, uint64_t sample)
+{
+	if (value == 0) {
+		return sample;
+	}
+	return (value * CHECKPOINT__SMOOTHING + sample) /
+	       (CHECKPOINT__SMOOTHING + 1);
+}
+
+void checkpoint_sched__init(struct checkpoint_sched *s)
+{
+	s->time = 0;
+	s->n_frames = 0;
+	s->growth = 0;
+	s->cost = 0;
+	s->target = 0;
+	s->retry = 0;
+	s->step = 0;
+	s->decision = CHECKPOINT_SKIP;
+}
+
+unsigned checkpoint_sched__max_frames(const struct config *config)
+{
+	uint64_t frame_size =
+	    (uint64_t)formatWalCalcFrameSize(config->page_size);
+	uint64_t n = config->checkpoint_max_wal_size / frame_size;
+
+	if (n < config->checkpoint_threshold) {
+		n = config->checkpoint_threshold;
+	}
+	if (n > UINT32_MAX) {
+		n = UINT32_MAX;
+	}
+	return (unsigned)n;
+}
+
+/* Update the growth rate with a new observation. */
+static void observe(struct checkpoint_sched *s, unsigned n_frames, uint64_t now)
+{
+	if (n_frames < s->n_frames) {
+		/* The WAL was truncated or restarted, start over. */
+		s->retry = 0;
+		s->step = 0;
+	} else if (s->time != 0 && now > s->time) {
+		uint64_t sample = (uint64_t)(n_frames - s->n_frames) *
+				  1000000000 / (now - s->time);
+		s->growth = smooth(s->growth, sample);
+	}
+	s->time = now;
+	s->n_frames = n_frames;
+}
+
+/* Soft target given the configuration and the recent checkpoint cost. */
+static unsigned target(const struct checkpoint_sched *s,
+		       const struct config *config)
+{
+	unsigned threshold = config->checkpoint_threshold;
+	uint64_t budget;
+	uint64_t min;
+
+	if (s->cost == 0) {
+		return threshold;
+	}
+
+	/* Number of frames that can be checkpointed within the latency
+	 * target. */
+	budget = (uint64_t)config->checkpoint_latency * 1000 / s->cost;
+	if (budget >= threshold) {
+		return threshold;
+	}
+
+	min = threshold / CHECKPOINT__MIN_TARGET_DIVISOR;
+	if (min == 0) {
+		min = 1;
+	}
+	return (unsigned)(budget > min ? budget : min);
+}
+
+int checkpoint_sched__decide(struct checkpoint_sched *s,
+			     const struct config *config,
+			     unsigned n_frames,
+			     uint64_t now)
+{
+	unsigned max_frames = checkpoint_sched__max_frames(config);
+
+	observe(s, n_frames, now);
+	s->target = target(s, config);
+
+	if (n_frames >= max_frames) {
+		s->decision = CHECKPOINT_HARD;
+	} else if (n_frames < s->target) {
+		s->decision = CHECKPOINT_SKIP;
+	} else if (n_frames < s->retry &&
+		   s->growth * CHECKPOINT__HORIZON / 1000000000 <
+		       max_frames - n_frames) {
+		s->decision = CHECKPOINT_BACKOFF;
+	} else {
+		s->decision = CHECKPOINT_SOFT;
+	}
+
+	return s->decision;
+}
+
+void checkpoint_sched__done(struct checkpoint_sched *s,
+			    unsigned n_frames,
+			    uint64_t duration)
+{
+	if (n_frames > 0) {
+		s->cost = smooth(s->cost, duration / n_frames);
+		if (s->cost == 0) {
+			s->cost = 1;
+		}
+	}
+}
+
+void checkpoint_sched__deferred(struct checkpoint_sched *s, unsigned n_frames)
+{
+	unsigned step;
+
+	if (s->step == 0) {
+		step = s->target / 4;
+	} else {
+		step = s->step * 2;
+		if (step > s->target) {
+			step = s->target;
+		}
+	}
+	if (step == 0) {
+		step = 1;
+	}
+	s->step = step;
+	s->retry = n_frames + step;
+}
+
+const char *checkpoint_sched__decision_name(int decision)
+{
+	switch (decision) {
+		case CHECKPOINT_SKIP:
+			return "skip";
+		case CHECKPOINT_BACKOFF:
+			return "backoff";
+		case CHECKPOINT_SOFT:
+			return "soft";
+		case CHECKPOINT_HARD:
+			return "hard";
+		default:
+			return "unknown";
+	}
+}
@@ -0,0 +1,79 @@
+/**
+ * Adaptive scheduling of WAL checkpoints.
+ *
+ * Every time a command is applied to a database, the scheduler looks at the
+ * size of its WAL and decides whether it's time to checkpoint it. The decision
+ * is based on:
+ *
+ * - a hard upper bound on the memory used by the WAL, past which a checkpoint
+ *   is always attempted;
+ * - a soft target on the WAL size, which starts at the configured checkpoint
+ *   threshold and gets lowered when checkpoints get so expensive that a single
+ *   one would exceed the configured latency target;
+ * - readers or writers that prevented the last attempt from completing, in
+ *   which case the scheduler waits for the WAL to grow by a step that doubles
+ *   at each failed attempt, unless the WAL growth rate predicts that the hard
+ *   bound will be reached soon. The step is reset once the WAL shrinks.
+ */
+
+#ifndef DQLITE_CHECKPOINT_H_
+#define DQLITE_CHECKPOINT_H_
+
+#include <stdint.h>
+
+#include "config.h"
+
+/* Decisions taken by the scheduler. */
+enum {
+	CHECKPOINT_SKIP,    /* The WAL is below the soft target */
+	CHECKPOINT_BACKOFF, /* The last attempt was deferred, wait a bit more */
+	CHECKPOINT_SOFT,    /* The WAL reached the soft target */
+	CHECKPOINT_HARD,    /* The WAL reached the hard bound */
+	CHECKPOINT_N_DECISIONS
+};
+
+struct checkpoint_sched
+{
+	uint64_t time;     /* Time of the last observation, in nanoseconds */
+	unsigned n_frames; /* WAL size at the last observation */
+	uint64_t growth;   /* Smoothed WAL growth rate, in frames per second */
+	uint64_t cost;     /* Smoothed checkpoint cost, in ns per frame */
+	unsigned target;   /* Current soft target, in frames */
+	unsigned retry;    /* WAL size to wait for after a deferred attempt */
+	unsigned step;     /* Last backoff step, in frames */
+	int decision;      /* Last decision taken */
+};
+
+void checkpoint_sched__init(struct checkpoint_sched *s);
+
+/**
+ * Observe the size of the WAL at the given time and return one of the
+ * CHECKPOINT_* decisions.
+ */
+int checkpoint_sched__decide(struct checkpoint_sched *s,
+			     const struct config *config,
+			     unsigned n_frames,
+			     uint64_t now);
+
+/**
+ * Account for a checkpoint that copied back n_frames frames in the given
+ * number of nanoseconds.
+ */
+void checkpoint_sched__done(struct checkpoint_sched *s,
+			    unsigned n_frames,
+			    uint64_t duration);
+
+/**
+ * Account for an attempt that left n_frames frames in the WAL because of
+ * active readers or writers.
+ */
+void checkpoint_sched__deferred(struct checkpoint_sched *s, unsigned n_frames);
+
+/**
+ * Maximum number of frames that the WAL can hold according to the hard bound.
+ */
+unsigned checkpoint_sched__max_frames(const struct config *config);
+
+const char *checkpoint_sched__decision_name(int decision);
+
+#endif /* DQLITE_CHECKPOINT_H_ */
@@ -0,0 +1,289 @@
+#include <pthread.h>
+#include <string.h>
+
+#include "./lib/assert.h"
+#include "./lib/byte.h"
+
+#include "checksum.h"
+
+/* The vectorized kernels are only built for x86 with a compiler that supports
+ * per-function target attributes. Other hosts always use the scalar loop. */
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__) && \
+    !defined(__TINYC__) && defined(DQLITE_LITTLE_ENDIAN)
+#define CHECKSUM__X86
+#include <immintrin.h>
+#endif
+
+/* Maximum number of 32-bit words that can be checksummed in one call. */
+#define CHECKSUM__MAX_WORDS (65536 / 4)
+
+/* Inputs shorter than this are not worth vectorizing (e.g. frame and WAL
+ * headers). */
+#define CHECKSUM__MIN_VECTOR_SIZE 256
+
+/* Scalar implementation of the checksum recurrence:
+ *
+ *   s1 += x[2i] + s2
+ *   s2 += x[2i+1] + s1
+ *
+ * with all arithmetic modulo 2^32. */
+static void checksumScalar(bool native,
+			   const uint8_t *data,
+			   size_t n,
+			   uint32_t sums[2])
+{
+	const uint8_t *end = data + n;
+	uint32_t s1 = sums[0];
+	uint32_t s2 = sums[1];
+	uint32_t x0;
+	uint32_t x1;
+
+	if (native) {
+		for (; data != end; data += 8) {
+			memcpy(&x0, data, sizeof x0);
+			memcpy(&x1, data + 4, sizeof x1);
+			s1 += x0 + s2;
+			s2 += x1 + s1;
+		}
+	} else {
+		for (; data != end; data += 8) {
+#if defined(DQLITE_LITTLE_ENDIAN)
+			x0 = ByteGetBe32(data);
+			x1 = ByteGetBe32(data + 4);
+#elif defined(DQLITE_BIG_ENDIAN)
+			x0 = ByteGetLe32(data);
+			x1 = ByteGetLe32(data + 4);
+#else
+			memcpy(&x0, data, sizeof x0);
+			memcpy(&x1, data + 4, sizeof x1);
+			x0 = __builtin_bswap32(x0);
+			x1 = __builtin_bswap32(x1);
+#endif
+			s1 += x0 + s2;
+			s2 += x1 + s1;
+		}
+	}
+
+	sums[0] = s1;
+	sums[1] = s2;
+}
+
+#if defined(CHECKSUM__X86)
+
+/* Unrolling the recurrence over N = 2n words gives a closed form in terms of
+ * the Fibonacci numbers F(k) (F(0) = 0, F(1) = 1), again modulo 2^32:
+ *
+ *   s1' = F(N-1) * s1 + F(N) * s2   + sum(x[j] * F(N-1-j))
+ *   s2' = F(N) * s1   + F(N+1) * s2 + sum(x[j] * F(N-j))
+ *
+ * so the checksum of a block boils down to two dot products between the input
+ * words and a window of Fibonacci numbers, which vectorizes well.
+ *
+ * The table holds the sequence in reverse order, checksumFib[t] = F(TOP - t),
+ * so that the weights of consecutive words are at consecutive addresses. */
+#define CHECKSUM__FIB_TOP (CHECKSUM__MAX_WORDS + 1)
+
+static uint32_t checksumFib[CHECKSUM__FIB_TOP + 1];
+
+/* Weights of the first input word for s1 and s2, given the number of words. */
+#define checksumWeights1(N) (&checksumFib[CHECKSUM__FIB_TOP - (N) + 1])
+#define checksumWeights2(N) (&checksumFib[CHECKSUM__FIB_TOP - (N)])
+
+/* Fold the sums of the weighted input words into the initial checksum. */
+static void checksumCombine(size_t n_words,
+			    uint32_t dot1,
+			    uint32_t dot2,
+			    uint32_t sums[2])
+{
+	uint32_t f_n1 = checksumFib[CHECKSUM__FIB_TOP - n_words + 1];
+	uint32_t f_n = checksumFib[CHECKSUM__FIB_TOP - n_words];
+	uint32_t f_n2 = checksumFib[CHECKSUM__FIB_TOP - n_words - 1];
+	uint32_t s1 = sums[0];
+	uint32_t s2 = sums[1];
+
+	sums[0] = f_n1 * s1 + f_n * s2 + dot1;
+	sums[1] = f_n * s1 + f_n2 * s2 + dot2;
+}
+
+/* Multiply packed 32-bit integers keeping the low 32 bits of each product,
+ * which SSE2 lacks a single instruction for. */
+__attribute__((target("sse2"))) static inline __m128i checksumMulloSse2(
+    __m128i a,
+    __m128i b)
+{
+	__m128i even = _mm_mul_epu32(a, b);
+	__m128i odd = _mm_mul_epu32(_mm_srli_epi64(a, 32), _mm_srli_epi64(b, 32));
+	return _mm_unpacklo_epi32(_mm_shuffle_epi32(even, _MM_SHUFFLE(0, 0, 2, 0)),
+				  _mm_shuffle_epi32(odd, _MM_SHUFFLE(0, 0, 2, 0)));
+}
+
+__attribute__((target("sse2"))) static inline uint32_t checksumSumSse2(
+    __m128i v)
+{
+	v = _mm_add_epi32(v, _mm_shuffle_epi32(v, _MM_SHUFFLE(1, 0, 3, 2)));
+	v = _mm_add_epi32(v, _mm_shuffle_epi32(v, _MM_SHUFFLE(2, 3, 0, 1)));
+	return (uint32_t)_mm_cvtsi128_si32(v);
+}
+
+__attribute__((target("sse2"))) static void checksumSse2(const uint8_t *data,
+							  size_t n,
+							  uint32_t sums[2])
+{
+	size_t n_words = n / 4;
+	const uint32_t *w1 = checksumWeights1(n_words);
+	const uint32_t *w2 = checksumWeights2(n_words);
+	__m128i acc1 = _mm_setzero_si128();
+	__m128i acc2 = _mm_setzero_si128();
+	uint32_t dot1;
+	uint32_t dot2;
+	uint32_t x;
+	size_t i;
+
+	for (i = 0; i + 4 <= n_words; i += 4) {
+		__m128i v = _mm_loadu_si128((const __m128i *)(data + i * 4));
+		__m128i k1 = _mm_loadu_si128((const __m128i *)(w1 + i));
+		__m128i k2 = _mm_loadu_si128((const __m128i *)(w2 + i));
+		acc1 = _mm_add_epi32(acc1, checksumMulloSse2(v, k1));
+		acc2 = _mm_add_epi32(acc2, checksumMulloSse2(v, k2));
+	}
+
+	dot1 = checksumSumSse2(acc1);
+	dot2 = checksumSumSse2(acc2);
+	for (; i < n_words; i++) {
+		memcpy(&x, data + i * 4, sizeof x);
+		dot1 += x * w1[i];
+		dot2 += x * w2[i];
+	}
+
+	checksumCombine(n_words, dot1, dot2, sums);
+}
+
+__attribute__((target("avx2"))) static void checksumAvx2(const uint8_t *data,
+							  size_t n,
+							  uint32_t sums[2])
+{
+	size_t n_words = n / 4;
+	const uint32_t *w1 = checksumWeights1(n_words);
+	const uint32_t *w2 = checksumWeights2(n_words);
+	__m256i acc1 = _mm256_setzero_si256();
+	__m256i acc2 = _mm256_setzero_si256();
+	__m128i lo;
+	__m128i hi;
+	uint32_t dot1;
+	uint32_t dot2;
+	uint32_t x;
+	size_t i;
+
+	for (i = 0; i + 8 <= n_words; i += 8) {
+		__m256i v = _mm256_loadu_si256((const __m256i *)(data + i * 4));
+		__m256i k1 = _mm256_loadu_si256((const __m256i *)(w1 + i));
+		__m256i k2 = _mm256_loadu_si256((const __m256i *)(w2 + i));
+		acc1 = _mm256_add_epi32(acc1, _mm256_mullo_epi32(v, k1));
+		acc2 = _mm256_add_epi32(acc2, _mm256_mullo_epi32(v, k2));
+	}
+
+	lo = _mm256_castsi256_si128(acc1);
+	hi = _mm256_extracti128_si256(acc1, 1);
+	dot1 = checksumSumSse2(_mm_add_epi32(lo, hi));
+	lo = _mm256_castsi256_si128(acc2);
+	hi = _mm256_extracti128_si256(acc2, 1);
+	dot2 = checksumSumSse2(_mm_add_epi32(lo, hi));
+	for (; i < n_words; i++) {
+		memcpy(&x, data + i * 4, sizeof x);
+		dot1 += x * w1[i];
+		dot2 += x * w2[i];
+	}
+
+	checksumCombine(n_words, dot1, dot2, sums);
+}
+
+#endif /* CHECKSUM__X86 */
+
+/* Implementation picked for this host, set once by checksumInit. */
+static enum checksum_impl checksumBest = CHECKSUM_SCALAR;
+static pthread_once_t checksumOnce = PTHREAD_ONCE_INIT;
+
+static void checksumInit(void)
+{
+#if defined(CHECKSUM__X86)
+	size_t t;
+
+	checksumFib[CHECKSUM__FIB_TOP] = 0;
+	checksumFib[CHECKSUM__FIB_TOP - 1] = 1;
+	for (t = CHECKSUM__FIB_TOP - 1; t > 0; t--) {
+		checksumFib[t - 1] = checksumFib[t] + checksumFib[t + 1];
+	}
+
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2")) {
+		checksumBest = CHECKSUM_AVX2;
+	} else if (__builtin_cpu_supports("sse2")) {
+		checksumBest = CHECKSUM_SSE2;
+	}
+#endif
+}
+
+void ChecksumWalWith(enum checksum_impl impl,
+		     bool native,
+		     const void *data,
+		     size_t n,
+		     uint32_t sums[2])
+{
+	assert(n >= 8);
+	assert(n % 8 == 0);
+	assert(n <= CHECKSUM__MAX_WORDS * 4);
+	assert(ChecksumImplSupported(impl));
+
+#if defined(CHECKSUM__X86)
+	if (native && n >= CHECKSUM__MIN_VECTOR_SIZE) {
+		switch (impl) {
+			case CHECKSUM_AVX2:
+				checksumAvx2(data, n, sums);
+				return;
+			case CHECKSUM_SSE2:
+				checksumSse2(data, n, sums);
+				return;
+			default:
+				break;
+		}
+	}
+#endif
+
+	checksumScalar(native, data, n, sums);
+}
+
+void ChecksumWal(bool native, const void *data, size_t n, uint32_t sums[2])
+{
+	pthread_once(&checksumOnce, checksumInit);
+	ChecksumWalWith(checksumBest, native, data, n, sums);
+}
+
+bool ChecksumImplSupported(enum checksum_impl impl)
+{
+	pthread_once(&checksumOnce, checksumInit);
+	switch (impl) {
+		case CHECKSUM_SCALAR:
+			return true;
+		case CHECKSUM_SSE2:
+			return checksumBest == CHECKSUM_SSE2 ||
+			       checksumBest == CHECKSUM_AVX2;
+		case CHECKSUM_AVX2:
+			return checksumBest == CHECKSUM_AVX2;
+		default:
+			return false;
+	}
+}
+
+const char *ChecksumImplName(enum checksum_impl impl)
+{
+	switch (impl) {
+		case CHECKSUM_SCALAR:
+			return "scalar";
+		case CHECKSUM_SSE2:
+			return "sse2";
+		case CHECKSUM_AVX2:
+			return "avx2";
+		default:
+			return "unknown";
+	}
+}
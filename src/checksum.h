@@ -0,0 +1,46 @@
+/* Checksum used by SQLite for WAL headers, frames and the WAL index header.
+ *
+ * The checksum is a Fletcher-style sum over the content interpreted as an array
+ * of 32-bit words, see https://sqlite.org/fileformat.html#checksum_algorithm.
+ * Long inputs are processed with SSE2 or AVX2 kernels when the host CPU
+ * supports them, picked once at runtime. */
+
+#ifndef DQLITE_CHECKSUM_H_
+#define DQLITE_CHECKSUM_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Available checksum implementations. */
+enum checksum_impl {
+	CHECKSUM_SCALAR, /* Portable word-by-word loop */
+	CHECKSUM_SSE2,   /* 4 words at a time, x86 only */
+	CHECKSUM_AVX2,   /* 8 words at a time, x86 only */
+	CHECKSUM_N_IMPL
+};
+
+/* Extend the checksum in sums[] with the n bytes in data.
+ *
+ * If native is true the content is interpreted as 32-bit words in the host
+ * byte order, otherwise in the opposite byte order. The data pointer doesn't
+ * need to be aligned, n must be a positive multiple of 8 not bigger than
+ * 65536. */
+void ChecksumWal(bool native, const void *data, size_t n, uint32_t sums[2]);
+
+/* Same as ChecksumWal, but use the given implementation, which must be
+ * supported by the host. Inputs that can't be vectorized are always handled by
+ * the scalar implementation. */
+void ChecksumWalWith(enum checksum_impl impl,
+		     bool native,
+		     const void *data,
+		     size_t n,
+		     uint32_t sums[2]);
+
+/* Return true if the given implementation can run on this host. */
+bool ChecksumImplSupported(enum checksum_impl impl);
+
+/* Human readable name of the given implementation. */
+const char *ChecksumImplName(enum checksum_impl impl);
+
+#endif /* DQLITE_CHECKSUM_H_ */
@@ -949,6 +949,15 @@ int clientSendWeight(struct client_proto *c,
 	return 0;
 }
 
+int clientSendMetrics(struct client_proto *c, struct client_context *context)
+{
+	tracef("client send metrics");
+	struct request_metrics request;
+	request.format = DQLITE_REQUEST_METRICS_FORMAT_V0;
+	REQUEST(metrics, METRICS, 0);
+	return 0;
+}
+
 int clientRecvServer(struct client_proto *c,
 		     uint64_t *id,
 		     char **address,
@@ -1120,3 +1129,48 @@ int clientRecvMetadata(struct client_proto *c,
 	*weight = response.weight;
 	return 0;
 }
+
+int clientRecvMetrics(struct client_proto *c,
+		      struct client_metric **metrics,
+		      size_t *n_metrics,
+		      struct client_context *context)
+{
+	tracef("client recv metrics");
+	struct cursor cursor;
+	struct response_metrics response;
+	struct client_metric *ms;
+	const char *raw_name;
+	size_t n;
+	size_t i = 0;
+	size_t j;
+	int rv;
+	*metrics = NULL;
+	*n_metrics = 0;
+	RESPONSE(metrics, METRICS);
+
+	n = (size_t)response.n;
+	assert((uint64_t)n == response.n);
+	ms = callocChecked(n, sizeof *ms);
+	for (; i < n; ++i) {
+		rv = text__decode(&cursor, &raw_name);
+		if (rv != 0) {
+			goto err_after_alloc_ms;
+		}
+		rv = uint64__decode(&cursor, &ms[i].value);
+		if (rv != 0) {
+			goto err_after_alloc_ms;
+		}
+		ms[i].name = strdupChecked(raw_name);
+	}
+
+	*metrics = ms;
+	*n_metrics = n;
+	return 0;
+
+err_after_alloc_ms:
+	for (j = 0; j < i; ++j) {
+		free(ms[j].name);
+	}
+	free(ms);
+	return rv;
+}
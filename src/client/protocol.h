@@ -94,6 +94,12 @@ struct client_file
 	void *blob;
 };
 
+struct client_metric
+{
+	char *name;
+	uint64_t value;
+};
+
 /* Checked allocation functions that abort the process on allocation failure. */
 
 void *mallocChecked(size_t n);
@@ -241,6 +247,10 @@ DQLITE_VISIBLE_TO_TESTS int clientSendWeight(struct client_proto *c,
 					     uint64_t weight,
 					     struct client_context *context);
 
+/* Send a request to retrieve the metrics of the attached server. */
+DQLITE_VISIBLE_TO_TESTS int clientSendMetrics(struct client_proto *c,
+					      struct client_context *context);
+
 /* Receive a response with the ID and address of a single node. */
 DQLITE_VISIBLE_TO_TESTS int clientRecvServer(struct client_proto *c,
 					     uint64_t *id,
@@ -279,4 +289,10 @@ DQLITE_VISIBLE_TO_TESTS int clientRecvMetadata(struct client_proto *c,
 					       uint64_t *weight,
 					       struct client_context *context);
 
+/* Receive the metrics of a server, as name and value pairs. */
+DQLITE_VISIBLE_TO_TESTS int clientRecvMetrics(struct client_proto *c,
+					      struct client_metric **metrics,
+					      size_t *n_metrics,
+					      struct client_context *context);
+
 #endif /* DQLITE_CLIENT_PROTOCOL_H_ */
@@ -37,6 +37,13 @@ static void frames__encode(const frames_t *frames, char **cursor)
 	uint16__encode(&frames->page_size, cursor);
 	uint16__encode(&frames->__unused__, cursor);
 	list = frames->data;
+	if (list == NULL) {
+		/* Leave room for page numbers and pages, which the caller
+		 * will fill in place. */
+		*cursor += sizeof(uint64_t) * frames->n_pages;
+		*cursor += (size_t)frames->page_size * frames->n_pages;
+		return;
+	}
 	for (i = 0; i < frames->n_pages; i++) {
 		uint64_t pgno = list[i].page_number;
 		uint64__encode(&pgno, cursor);
@@ -167,3 +174,28 @@ void command_frames__pages(const struct command_frames *c, void **pages)
 	*pages =
 	    (void *)(c->frames.data + (sizeof(uint64_t) * c->frames.n_pages));
 }
+
+int command_frames__encode_in_place(const struct command_frames *c,
+				    struct raft_buffer *buf,
+				    void **page_numbers,
+				    void **pages)
+{
+	struct command_frames layout = *c;
+	size_t pages_size;
+	int rc;
+
+	layout.frames.data = NULL;
+	rc = command__encode(COMMAND_FRAMES, &layout, buf);
+	if (rc != 0) {
+		return rc;
+	}
+
+	/* The frames are the last field of the command, and the page data is
+	 * the last part of the frames. */
+	pages_size = (size_t)c->frames.page_size * c->frames.n_pages;
+	*pages = (char *)buf->base + buf->len - pages_size;
+	*page_numbers =
+	    (char *)*pages - sizeof(uint64_t) * c->frames.n_pages;
+
+	return 0;
+}
@@ -62,6 +62,19 @@ DQLITE_VISIBLE_TO_TESTS int command__decode(const struct raft_buffer *buf,
 					    int *type,
 					    void **command);
 
+/* Encode a COMMAND_FRAMES command, leaving its page numbers and pages for the
+ * caller to fill directly into the returned buffer, so no intermediate copy of
+ * the pages is needed. The frames.data field of the command is ignored.
+ *
+ * On success page_numbers points to room for frames.n_pages 64-bit
+ * little-endian integers and pages to room for frames.n_pages pages. Both are
+ * 8-byte aligned. */
+DQLITE_VISIBLE_TO_TESTS int command_frames__encode_in_place(
+    const struct command_frames *c,
+    struct raft_buffer *buf,
+    void **page_numbers,
+    void **pages);
+
 DQLITE_VISIBLE_TO_TESTS int command_frames__page_numbers(
     const struct command_frames *c,
     unsigned long *page_numbers[]);
@@ -23,6 +23,18 @@
  * soon as possible. */
 #define DEFAULT_CHECKPOINT_THRESHOLD 1000
 
+/* Size in bytes of the WAL of a database past which a checkpoint is always
+ * attempted, regardless of its cost. */
+#define DEFAULT_CHECKPOINT_MAX_WAL_SIZE (64 * 1024 * 1024)
+
+/* Checkpoints are scheduled so that each one takes about this many
+ * microseconds at most, see checkpoint.h. */
+#define DEFAULT_CHECKPOINT_LATENCY 10000
+
+/* Maximum number of WAL frames released by a checkpoint that are kept around
+ * for reuse by each database. */
+#define DEFAULT_FRAME_POOL_CAP 256
+
 /* For generating unique replication/VFS registration names.
  *
  * TODO: make this thread safe. */
@@ -43,6 +55,9 @@ int config__init(struct config *c,
 	c->heartbeat_timeout = DEFAULT_HEARTBEAT_TIMEOUT;
 	c->page_size = DEFAULT_PAGE_SIZE;
 	c->checkpoint_threshold = DEFAULT_CHECKPOINT_THRESHOLD;
+	c->checkpoint_max_wal_size = DEFAULT_CHECKPOINT_MAX_WAL_SIZE;
+	c->checkpoint_latency = DEFAULT_CHECKPOINT_LATENCY;
+	c->frame_pool_cap = DEFAULT_FRAME_POOL_CAP;
 	rv = snprintf(c->name, sizeof c->name, "dqlite-%u", serial);
 	assert(rv < (int)(sizeof c->name));
 	c->logger.data = NULL;
@@ -12,6 +12,9 @@ struct config {
 	unsigned heartbeat_timeout;    /* In milliseconds */
 	unsigned page_size;            /* Database page size */
 	unsigned checkpoint_threshold; /* In outstanding WAL frames */
+	uint64_t checkpoint_max_wal_size; /* Hard bound on WAL size, in bytes */
+	unsigned checkpoint_latency;   /* Target checkpoint time, in usecs */
+	unsigned frame_pool_cap;       /* Recycled WAL frames per database */
 	struct logger logger;          /* Custom logger */
 	char name[256];                /* VFS/replication registriatio name */
 	unsigned long long failure_domain; /* User-provided failure domain */
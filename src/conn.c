@@ -89,6 +89,7 @@ static void gateway_handle_cb(struct handle *req,
 
 	buf.base = buffer__cursor(&c->write, 0);
 	buf.len = buffer__offset(&c->write);
+	dqlite__metrics_bytes_out(&c->gateway.registry->metrics, buf.len);
 
 	rv = transport__write(&c->transport, &buf, conn_write_cb);
 	if (rv != 0) {
@@ -205,6 +206,9 @@ static void read_message_cb(struct transport *transport, int status)
 
 	rv = message__decode(&cursor, &c->request);
 	assert(rv == 0); /* Can't fail, we know we have enough bytes */
+	dqlite__metrics_bytes_in(&c->gateway.registry->metrics,
+				 message__sizeof(&c->request) +
+				     (uint64_t)c->request.words * 8);
 
 	rv = read_request(c);
 	if (rv != 0) {
@@ -57,9 +57,22 @@ int db__init(struct db *db, struct config *config, const char *filename)
 		goto err_after_path_alloc;
 	}
 
+	rv = uv_sem_init(&db->checkpoint.done, 0);
+	if (rv != 0) {
+		rv = DQLITE_ERROR;
+		goto err_after_path_alloc;
+	}
+	db->checkpoint.state = DB_CHECKPOINT_IDLE;
+	db->checkpoint.work = (pool_work_t){};
+	queue_init(&db->checkpoint.deferred);
+	queue_init(&db->checkpoint.released);
+	queue_init(&db->checkpoint.barriers);
+	checkpoint_sched__init(&db->checkpoint.sched);
+
 	db->follower = NULL;
 	db->tx_id = 0;
 	db->read_lock = 0;
+	db->metrics = NULL;
 	queue_init(&db->leaders);
 	return 0;
 
@@ -74,6 +87,9 @@ err:
 void db__close(struct db *db)
 {
 	assert(queue_empty(&db->leaders));
+	assert(db->checkpoint.state == DB_CHECKPOINT_IDLE);
+	assert(queue_empty(&db->checkpoint.deferred));
+	uv_sem_destroy(&db->checkpoint.done);
 	if (db->follower != NULL) {
 		int rc;
 		rc = sqlite3_close(db->follower);
@@ -5,10 +5,36 @@
 #ifndef DB_H_
 #define DB_H_
 
+#include <stdbool.h>
 #include <stdint.h>
 #include "lib/queue.h"
+#include "lib/threadpool.h"
 
+#include "checkpoint.h"
 #include "config.h"
+#include "metrics.h"
+
+/* States of the background checkpoint of a database. */
+enum {
+	DB_CHECKPOINT_IDLE,     /* No checkpoint in progress */
+	DB_CHECKPOINT_RUNNING,  /* A pool thread owns the database */
+	DB_CHECKPOINT_DRAINING, /* Completed, the work item is being retired */
+};
+
+/* Checkpoint of a database running on the thread pool, see fsm.c. */
+struct db_checkpoint
+{
+	int state;          /* One of the DB_CHECKPOINT_* values */
+	pool_work_t work;   /* Work item queued on the pool */
+	uv_sem_t done;      /* Posted by the pool thread when finished */
+	bool ok;            /* Whether the WAL was checkpointed */
+	unsigned n_frames;  /* Size of the WAL when the checkpoint started */
+	uint64_t duration;  /* Time spent checkpointing, in nanoseconds */
+	queue deferred;     /* Frames committed while running */
+	queue released;     /* Raft entries released while running */
+	queue barriers;     /* Leader barriers waiting for the checkpoint */
+	struct checkpoint_sched sched; /* When to checkpoint */
+};
 
 struct db
 {
@@ -21,6 +47,8 @@ struct db
 	unsigned tx_id;        /* Current ongoing transaction ID, if any */
 	queue queue;           /* Prev/next database, used by the registry */
 	int read_lock;         /* Lock used by snapshots & checkpoints */
+	struct db_checkpoint checkpoint;  /* Background checkpoint */
+	struct dqlite__metrics *metrics;  /* Node metrics, may be NULL */
 };
 
 /**
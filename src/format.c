@@ -6,14 +6,9 @@
 
 #include "./lib/assert.h"
 
+#include "checksum.h"
 #include "format.h"
 
-/* tinycc doesn't have this builtin, nor the warning that it's meant to silence.
- */
-#ifdef __TINYC__
-#define __builtin_assume_aligned(x, y) x
-#endif
-
 /* WAL magic value. Either this value, or the same value with the least
  * significant bit also set (FORMAT__WAL_MAGIC | 0x00000001) is stored in 32-bit
  * big-endian format in the first 4 bytes of a WAL file.
@@ -44,66 +39,6 @@ static void formatPut32(uint32_t v, uint8_t *buf)
 	buf[3] = (uint8_t)v;
 }
 
-/*
- * Generate or extend an 8 byte checksum based on the data in array data[] and
- * the initial values of in[0] and in[1] (or initial values of 0 and 0 if
- * in==NULL).
- *
- * The checksum is written back into out[] before returning.
- *
- * n must be a positive multiple of 8. */
-static void formatWalChecksumBytes(
-    bool native,   /* True for native byte-order, false for non-native */
-    uint8_t *data, /* Content to be checksummed */
-    unsigned n,    /* Bytes of content in a[].  Must be a multiple of 8. */
-    const uint32_t in[2], /* Initial checksum value input */
-    uint32_t out[2]       /* OUT: Final checksum value output */
-)
-{
-	uint32_t s1, s2;
-	/* `data` is an alias for the `hdr` member of a `struct vfsWal`. `hdr`
-	 * is the first member of this struct. Because `struct vfsWal` contains
-	 * pointer members, the struct itself will have the alignment of the
-	 * pointer members. As `hdr` is the first member, it will have this
-	 * alignment too. Therefore it is safe to assume pointer alignment (and
-	 * silence the compiler). more info ->
-	 * http://www.catb.org/esr/structure-packing/ */
-	uint32_t *cur =
-	    (uint32_t *)__builtin_assume_aligned(data, sizeof(void *));
-	uint32_t *end =
-	    (uint32_t *)__builtin_assume_aligned(&data[n], sizeof(void *));
-
-	if (in) {
-		s1 = in[0];
-		s2 = in[1];
-	} else {
-		s1 = s2 = 0;
-	}
-
-	assert(n >= 8);
-	assert((n & 0x00000007) == 0);
-	assert(n <= 65536);
-
-	if (native) {
-		do {
-			s1 += *cur++ + s2;
-			s2 += *cur++ + s1;
-		} while (cur < end);
-	} else {
-		do {
-			uint32_t d;
-			formatPut32(cur[0], (uint8_t *)&d);
-			s1 += d + s2;
-			formatPut32(cur[1], (uint8_t *)&d);
-			s2 += d + s1;
-			cur += 2;
-		} while (cur < end);
-	}
-
-	out[0] = s1;
-	out[1] = s2;
-}
-
 void formatWalRestartHeader(uint8_t *header)
 {
 	uint32_t checksum[2] = {0, 0};
@@ -124,7 +59,7 @@ void formatWalRestartHeader(uint8_t *header)
 	sqlite3_randomness(4, &header[20]);
 
 	/* Update the checksum. */
-	formatWalChecksumBytes(true, header, 24, checksum, checksum);
+	ChecksumWal(true, header, 24, checksum);
 	formatPut32(checksum[0], header + 24);
 	formatPut32(checksum[1], header + 28);
 }
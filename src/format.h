@@ -24,6 +24,14 @@
 /* Number of reader marks in the wal index header. */
 #define FORMAT__WAL_NREADER 5
 
+/* Index of the first reader lock in the wal index. The lower ones are the
+ * writer, checkpointer and recovery locks. */
+#define FORMAT__WAL_READ_LOCK0 3
+
+/* Offset in the wal index of the number of WAL frames that were already
+ * copied back into the database (nBackfill). */
+#define FORMAT__WAL_IDX_N_BACKFILL 96
+
 /* Given the page size, calculate the size of a full WAL frame (frame header
  * plus page data). */
 #define formatWalCalcFrameSize(PAGE_SIZE) \
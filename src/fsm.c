@@ -2,9 +2,13 @@
 #include "lib/serialize.h"
 
 #include "command.h"
+#include "format.h"
 #include "fsm.h"
+#include "leader.h"
 #include "raft.h"
+#include "server.h"
 #include "tracing.h"
+#include "utils.h"
 #include "vfs.h"
 
 #include <sys/mman.h>
@@ -13,6 +17,7 @@ struct fsm
 {
 	struct logger *logger;
 	struct registry *registry;
+	struct raft *raft; /* For pinning applied entries, may be NULL. */
 	struct
 	{
 		unsigned n_pages;
@@ -82,38 +87,15 @@ static int databaseReadUnlock(struct db *db)
 	}
 }
 
-static void maybeCheckpoint(struct db *db)
+/* Number of frames in the WAL of the given database, which must have its
+ * follower connection open. */
+static unsigned walNumFrames(struct db *db)
 {
-	tracef("maybe checkpoint");
-	struct sqlite3_file *main_f;
 	struct sqlite3_file *wal;
-	volatile void *region;
 	sqlite3_int64 size;
-	unsigned page_size;
-	unsigned pages;
-	int wal_size;
-	int ckpt;
-	int i;
+	unsigned page_size = db->config->page_size;
 	int rv;
 
-	/* Don't run when a snapshot is busy. Running a checkpoint while a
-	 * snapshot is busy will result in illegal memory accesses by the
-	 * routines that try to access database page pointers contained in the
-	 * snapshot. */
-	rv = databaseReadLock(db);
-	if (rv != 0) {
-		tracef("busy snapshot %d", rv);
-		return;
-	}
-
-	assert(db->follower == NULL);
-	rv = db__open_follower(db);
-	if (rv != 0) {
-		tracef("open follower failed %d", rv);
-		goto err_after_db_lock;
-	}
-
-	page_size = db->config->page_size;
 	/* Get the database wal file associated with this connection */
 	rv = sqlite3_file_control(db->follower, "main",
 				  SQLITE_FCNTL_JOURNAL_POINTER, &wal);
@@ -122,15 +104,20 @@ static void maybeCheckpoint(struct db *db)
 	rv = wal->pMethods->xFileSize(wal, &size);
 	assert(rv == SQLITE_OK); /* Should never fail */
 
-	/* Calculate the number of frames. */
-	pages = (unsigned)((size - 32) / (24 + page_size));
+	return (unsigned)((size - 32) / (24 + page_size));
+}
 
-	/* Check if the size of the WAL is beyond the threshold. */
-	if (pages < db->config->checkpoint_threshold) {
-		tracef("wal size (%u) < threshold (%u)", pages,
-		       db->config->checkpoint_threshold);
-		goto err_after_db_open;
-	}
+/* Return true if a reader or writer is active on the given database, which
+ * must have its follower connection open, and set reason accordingly. Also
+ * set n_backfilled to the number of WAL frames that were already copied back
+ * into the database. */
+static bool checkpointBusy(struct db *db, int *reason, unsigned *n_backfilled)
+{
+	struct sqlite3_file *main_f;
+	volatile void *region;
+	bool busy = false;
+	int i;
+	int rv;
 
 	/* Get the database file associated with this db->follower connection */
 	rv = sqlite3_file_control(db->follower, "main",
@@ -141,6 +128,9 @@ static void maybeCheckpoint(struct db *db)
 	rv = main_f->pMethods->xShmMap(main_f, 0, 0, 0, &region);
 	assert(rv == SQLITE_OK); /* Should never fail */
 
+	*n_backfilled = *(volatile uint32_t *)((volatile uint8_t *)region +
+					       FORMAT__WAL_IDX_N_BACKFILL);
+
 	rv = main_f->pMethods->xShmUnmap(main_f, 0);
 	assert(rv == SQLITE_OK); /* Should never fail */
 
@@ -150,8 +140,15 @@ static void maybeCheckpoint(struct db *db)
 
 		rv = main_f->pMethods->xShmLock(main_f, i, 1, flags);
 		if (rv == SQLITE_BUSY) {
-			tracef("busy reader or writer - retry next time");
-			goto err_after_db_open;
+			busy = true;
+			if (i < FORMAT__WAL_READ_LOCK0) {
+				tracef("busy writer - retry next time");
+				*reason = DQLITE__CHECKPOINT_WRITER;
+				return true;
+			}
+			tracef("busy reader %d", i - FORMAT__WAL_READ_LOCK0);
+			*reason = DQLITE__CHECKPOINT_READER;
+			continue;
 		}
 
 		/* Not locked. Let's release the lock we just
@@ -160,12 +157,23 @@ static void maybeCheckpoint(struct db *db)
 		main_f->pMethods->xShmLock(main_f, i, 1, flags);
 	}
 
+	return busy;
+}
+
+/* Checkpoint the whole WAL of the given database using its follower
+ * connection. Must be called only if checkpointBusy() returned false. */
+static bool checkpointRun(struct db *db)
+{
+	int wal_size;
+	int ckpt;
+	int rv;
+
 	rv = sqlite3_wal_checkpoint_v2(
 	    db->follower, "main", SQLITE_CHECKPOINT_TRUNCATE, &wal_size, &ckpt);
 	/* TODO assert(rv == 0) here? Which failure modes do we expect? */
 	if (rv != 0) {
 		tracef("sqlite3_wal_checkpoint_v2 failed %d", rv);
-		goto err_after_db_open;
+		return false;
 	}
 	tracef("sqlite3_wal_checkpoint_v2 success");
 
@@ -174,6 +182,335 @@ static void maybeCheckpoint(struct db *db)
 	assert(wal_size == 0);
 	assert(ckpt == 0);
 
+	return true;
+}
+
+/* Account for a successful checkpoint. */
+static void checkpointRecord(struct db *db,
+			     unsigned n_frames,
+			     uint64_t duration)
+{
+	tracef("checkpointed %u frames in %" PRIu64 " ns", n_frames, duration);
+	checkpoint_sched__done(&db->checkpoint.sched, n_frames, duration);
+	if (db->metrics != NULL) {
+		dqlite__metrics_checkpoint(db->metrics, n_frames, duration);
+	}
+}
+
+static const char *checkpointReasonName(int reason)
+{
+	switch (reason) {
+		case DQLITE__CHECKPOINT_READER:
+			return "reader";
+		case DQLITE__CHECKPOINT_WRITER:
+			return "writer";
+		default:
+			return "unknown";
+	}
+}
+
+/* Account for n_frames frames that a checkpoint had to leave in the WAL. */
+static void checkpointDefer(struct db *db, int reason, unsigned n_frames)
+{
+	tracef("deferred %u frames: busy %s", n_frames,
+	       checkpointReasonName(reason));
+	checkpoint_sched__deferred(&db->checkpoint.sched, n_frames);
+	if (db->metrics != NULL) {
+		dqlite__metrics_checkpoint_deferred(db->metrics, reason,
+						    n_frames);
+	}
+}
+
+/* Copy back into the database the WAL frames that no reader needs anymore,
+ * leaving the WAL in place. The WAL gets restarted by the next writer once
+ * all its frames are copied back and readers are gone, or truncated by the
+ * next full checkpoint. */
+static void checkpointPassive(struct db *db, unsigned n_backfilled)
+{
+	uint64_t start = uv_hrtime();
+	int wal_size;
+	int ckpt;
+	int rv;
+
+	rv = sqlite3_wal_checkpoint_v2(
+	    db->follower, "main", SQLITE_CHECKPOINT_PASSIVE, &wal_size, &ckpt);
+	if (rv != 0) {
+		tracef("sqlite3_wal_checkpoint_v2 passive failed %d", rv);
+		return;
+	}
+	assert(ckpt <= wal_size);
+
+	/* The backfill mark only moves forward while the WAL is in use. */
+	if ((unsigned)ckpt > n_backfilled) {
+		checkpointRecord(db, (unsigned)ckpt - n_backfilled,
+				 uv_hrtime() - start);
+	}
+	if (ckpt < wal_size) {
+		checkpointDefer(db, DQLITE__CHECKPOINT_READER,
+				(unsigned)(wal_size - ckpt));
+	}
+}
+
+/* Frames committed while a background checkpoint was using the database. */
+struct deferred_frames
+{
+	queue queue;
+	unsigned n_pages;
+	unsigned long *page_numbers;
+	void *pages;
+};
+
+static int deferFrames(struct db *db,
+		       unsigned n_pages,
+		       unsigned long *page_numbers,
+		       void *pages)
+{
+	struct deferred_frames *d;
+	size_t size = (size_t)n_pages * db->config->page_size;
+
+	tracef("defer %u frames", n_pages);
+	d = sqlite3_malloc(sizeof *d);
+	if (d == NULL) {
+		goto oom;
+	}
+	d->n_pages = n_pages;
+	d->page_numbers = sqlite3_malloc64(sizeof *page_numbers * n_pages);
+	if (d->page_numbers == NULL) {
+		goto oom_after_alloc;
+	}
+	d->pages = sqlite3_malloc64(size);
+	if (d->pages == NULL) {
+		goto oom_after_page_numbers_alloc;
+	}
+	memcpy(d->page_numbers, page_numbers, sizeof *page_numbers * n_pages);
+	memcpy(d->pages, pages, size);
+	queue_insert_tail(&db->checkpoint.deferred, &d->queue);
+	return 0;
+
+oom_after_page_numbers_alloc:
+	sqlite3_free(d->page_numbers);
+oom_after_alloc:
+	sqlite3_free(d);
+oom:
+	return DQLITE_NOMEM;
+}
+
+/* Append committed frames to the WAL, or hold them back if a background
+ * checkpoint is using the database. */
+static int applyCommitted(struct db *db,
+			  sqlite3_vfs *vfs,
+			  unsigned n_pages,
+			  unsigned long *page_numbers,
+			  void *pages)
+{
+	if (db->checkpoint.state == DB_CHECKPOINT_RUNNING) {
+		return deferFrames(db, n_pages, page_numbers, pages);
+	}
+	return VfsApply(vfs, db->path, n_pages, page_numbers, pages);
+}
+
+#ifndef USE_SYSTEM_RAFT
+static void release_borrowed_entries(struct db *db);
+#endif
+
+/* Wrap up a background checkpoint whose work is done. */
+static void checkpointFinish(struct db *db)
+{
+	struct db_checkpoint *c = &db->checkpoint;
+	sqlite3_vfs *vfs = sqlite3_vfs_find(db->config->name);
+	int rv;
+
+	assert(c->state == DB_CHECKPOINT_RUNNING);
+
+	sqlite3_close(db->follower);
+	db->follower = NULL;
+	rv = databaseReadUnlock(db);
+	assert(rv == 0);
+
+	if (c->ok) {
+		checkpointRecord(db, c->n_frames, c->duration);
+	}
+
+#ifndef USE_SYSTEM_RAFT
+	release_borrowed_entries(db);
+#endif
+
+	while (!queue_empty(&c->deferred)) {
+		struct deferred_frames *d;
+		queue *head = queue_head(&c->deferred);
+		queue_remove(head);
+		d = QUEUE_DATA(head, struct deferred_frames, queue);
+		rv = VfsApply(vfs, db->path, d->n_pages, d->page_numbers,
+			      d->pages);
+		if (rv != 0) {
+			tracef("apply deferred frames failed %d", rv);
+		}
+		sqlite3_free(d->page_numbers);
+		sqlite3_free(d->pages);
+		sqlite3_free(d);
+	}
+}
+
+/* Run in a pool thread, which owns the database until the checkpoint is
+ * finished. */
+static void checkpointWork(pool_work_t *w)
+{
+	struct db *db = CONTAINER_OF(w, struct db, checkpoint.work);
+	struct db_checkpoint *c = &db->checkpoint;
+	uint64_t start = uv_hrtime();
+
+	c->ok = checkpointRun(db);
+	c->duration = uv_hrtime() - start;
+	uv_sem_post(&c->done);
+}
+
+static void checkpointAfterWork(pool_work_t *w)
+{
+	struct db *db = CONTAINER_OF(w, struct db, checkpoint.work);
+	struct db_checkpoint *c = &db->checkpoint;
+
+	if (c->state == DB_CHECKPOINT_RUNNING) {
+		uv_sem_wait(&c->done);
+		checkpointFinish(db);
+	}
+	c->state = DB_CHECKPOINT_IDLE;
+	c->work = (pool_work_t){};
+
+	leader__resume_barriers(db);
+}
+
+void fsm__checkpoint_flush(struct db *db)
+{
+	struct db_checkpoint *c = &db->checkpoint;
+
+	if (c->state != DB_CHECKPOINT_RUNNING) {
+		return;
+	}
+	tracef("wait for background checkpoint");
+	uv_sem_wait(&c->done);
+	checkpointFinish(db);
+	c->state = DB_CHECKPOINT_DRAINING;
+}
+
+/* Return the pool that checkpoints should run on, or NULL if they should run
+ * synchronously. */
+static pool_t *checkpointPool(struct fsm *f)
+{
+#ifdef DQLITE_NEXT
+	struct dqlite_node *node;
+	if (f->raft == NULL) {
+		return NULL;
+	}
+	if (pool_ut_fallback()->flags & POOL_FOR_UT) {
+		return pool_ut_fallback();
+	}
+	node = f->raft->data;
+	return &node->pool;
+#else
+	(void)f;
+	return NULL;
+#endif
+}
+
+/* Whether a leader connection of the given database is executing a
+ * statement, possibly on a pool thread. */
+static bool execInProgress(struct db *db)
+{
+	queue *head;
+	QUEUE_FOREACH(head, &db->leaders)
+	{
+		struct leader *l = QUEUE_DATA(head, struct leader, queue);
+		if (l->exec != NULL) {
+			return true;
+		}
+	}
+	return false;
+}
+
+static void maybeCheckpoint(struct fsm *f, struct db *db)
+{
+	tracef("maybe checkpoint");
+	struct db_checkpoint *c = &db->checkpoint;
+	pool_t *pool = checkpointPool(f);
+	unsigned n_backfilled;
+	unsigned n_frames;
+	uint64_t start;
+	int decision;
+	int reason;
+	int rv;
+
+	/* Only one checkpoint at a time. */
+	if (c->state != DB_CHECKPOINT_IDLE) {
+		tracef("busy checkpoint");
+		return;
+	}
+
+	/* Don't run when a snapshot is busy. Running a checkpoint while a
+	 * snapshot is busy will result in illegal memory accesses by the
+	 * routines that try to access database page pointers contained in the
+	 * snapshot. */
+	rv = databaseReadLock(db);
+	if (rv != 0) {
+		tracef("busy snapshot %d", rv);
+		return;
+	}
+
+	assert(db->follower == NULL);
+	rv = db__open_follower(db);
+	if (rv != 0) {
+		tracef("open follower failed %d", rv);
+		goto err_after_db_lock;
+	}
+
+	/* Check if it's time to checkpoint, given the size of the WAL. */
+	n_frames = walNumFrames(db);
+	decision = checkpoint_sched__decide(&c->sched, db->config, n_frames,
+					    uv_hrtime());
+	tracef("wal %u frames (%" PRIu64 " bytes) target %u growth %" PRIu64
+	       " frames/s: %s",
+	       n_frames,
+	       (uint64_t)n_frames *
+		   formatWalCalcFrameSize(db->config->page_size),
+	       c->sched.target, c->sched.growth,
+	       checkpoint_sched__decision_name(decision));
+	if (db->metrics != NULL) {
+		dqlite__metrics_checkpoint_decision(db->metrics, decision);
+	}
+	if (decision == CHECKPOINT_SKIP || decision == CHECKPOINT_BACKOFF) {
+		goto err_after_db_open;
+	}
+
+	/* Readers only prevent the frames they might still need from being
+	 * copied back, so don't let them starve the checkpoint. */
+	if (checkpointBusy(db, &reason, &n_backfilled)) {
+		if (reason == DQLITE__CHECKPOINT_READER) {
+			checkpointPassive(db, n_backfilled);
+		} else {
+			checkpointDefer(db, reason, n_frames);
+		}
+		goto err_after_db_open;
+	}
+
+	/* While a leader connection is executing a statement the database is
+	 * not ours to hand over, checkpoint synchronously. */
+	if (pool != NULL && !execInProgress(db)) {
+		/* Hand the database over to a pool thread: the follower
+		 * connection and the snapshot lock are released by
+		 * checkpointFinish(). Until then new statements on leader
+		 * connections wait in leader__barrier() and committed frames
+		 * are deferred. */
+		c->state = DB_CHECKPOINT_RUNNING;
+		c->n_frames = n_frames;
+		pool_queue_work(pool, &c->work, db->cookie, WT_ORD1,
+				checkpointWork, checkpointAfterWork);
+		return;
+	}
+
+	start = uv_hrtime();
+	if (checkpointRun(db)) {
+		checkpointRecord(db, n_frames, uv_hrtime() - start);
+	}
+
 err_after_db_open:
 	sqlite3_close(db->follower);
 	db->follower = NULL;
@@ -182,7 +519,111 @@ err_after_db_lock:
 	assert(rv == 0);
 }
 
-static int apply_frames(struct fsm *f, const struct command_frames *c)
+#ifndef USE_SYSTEM_RAFT
+/* A raft entry whose pages are referenced by the WAL of a database. */
+struct borrowed_entry
+{
+	struct raft *raft;
+	raft_index index;
+	struct raft_entry *entry;
+	struct db *db;
+	queue queue;
+};
+
+static void release_borrowed_entry(void *arg)
+{
+	struct borrowed_entry *b = arg;
+
+	/* Raft can only be used from the loop thread, so if the WAL was
+	 * truncated by a background checkpoint just take note of the entry,
+	 * it will be released by checkpointFinish(). */
+	if (b->db->checkpoint.state == DB_CHECKPOINT_RUNNING) {
+		queue_insert_tail(&b->db->checkpoint.released, &b->queue);
+		return;
+	}
+
+	raft_entry_release(b->raft, b->index, b->entry);
+	raft_free(b);
+}
+
+static void release_borrowed_entries(struct db *db)
+{
+	while (!queue_empty(&db->checkpoint.released)) {
+		struct borrowed_entry *b;
+		queue *head = queue_head(&db->checkpoint.released);
+		queue_remove(head);
+		b = QUEUE_DATA(head, struct borrowed_entry, queue);
+		raft_entry_release(b->raft, b->index, b->entry);
+		raft_free(b);
+	}
+}
+#endif
+
+/* Try to append the frames of a commit to the WAL without copying them, by
+ * pinning the raft entry being applied until the next checkpoint. Return false
+ * if that's not possible, in which case the caller should apply a copy. */
+static bool apply_frames_borrowed(struct fsm *f,
+				  sqlite3_vfs *vfs,
+				  struct db *db,
+				  const struct command_frames *c,
+				  const struct raft_buffer *buf)
+{
+#ifndef USE_SYSTEM_RAFT
+	struct borrowed_entry *b;
+	void *pages;
+	int rv;
+
+	if (f->raft == NULL || c->frames.n_pages == 0 ||
+	    db->checkpoint.state == DB_CHECKPOINT_RUNNING) {
+		return false;
+	}
+
+	b = raft_malloc(sizeof *b);
+	if (b == NULL) {
+		return false;
+	}
+	b->raft = f->raft;
+	b->index = raft_last_applied(f->raft) + 1;
+	b->db = db;
+
+	rv = raft_entry_acquire(b->raft, b->index, &b->entry);
+	if (rv != 0) {
+		goto err_after_alloc;
+	}
+
+	/* Make sure this is the entry whose payload we're applying. */
+	if (b->entry->buf.base != buf->base) {
+		goto err_after_acquire;
+	}
+
+	command_frames__pages(c, &pages);
+	rv = VfsApplyBorrowed(vfs, db->path, c->frames.n_pages, c->frames.data,
+			      pages, release_borrowed_entry, b);
+	if (rv != 0) {
+		tracef("VfsApplyBorrowed failed %d", rv);
+		goto err_after_acquire;
+	}
+
+	return true;
+
+err_after_acquire:
+	raft_entry_release(b->raft, b->index, b->entry);
+err_after_alloc:
+	raft_free(b);
+	return false;
+#else
+	(void)f;
+	(void)vfs;
+	(void)db;
+	(void)c;
+	(void)buf;
+	return false;
+#endif
+}
+
+static int apply_frames(struct fsm *f,
+			const struct command_frames *c,
+			const struct raft_buffer *buf)
 {
 	tracef("fsm apply frames");
 	struct db *db;
@@ -215,6 +656,12 @@ static int apply_frames(struct fsm *f, const struct command_frames *c)
 		db->follower = NULL;
 	}
 
+	if (c->is_commit && f->pending.n_pages == 0 &&
+	    apply_frames_borrowed(f, vfs, db, c, buf)) {
+		maybeCheckpoint(f, db);
+		return 0;
+	}
+
 	rv = command_frames__page_numbers(c, &page_numbers);
 	if (rv != 0) {
 		if (page_numbers != NULL) {
@@ -240,9 +687,9 @@ static int apply_frames(struct fsm *f, const struct command_frames *c)
 				sqlite3_free(page_numbers);
 				return DQLITE_NOMEM;
 			}
-			rv =
-			    VfsApply(vfs, db->path, f->pending.n_pages,
-				     f->pending.page_numbers, f->pending.pages);
+			rv = applyCommitted(db, vfs, f->pending.n_pages,
+					    f->pending.page_numbers,
+					    f->pending.pages);
 			if (rv != 0) {
 				tracef("VfsApply failed %d", rv);
 				sqlite3_free(page_numbers);
@@ -254,8 +701,8 @@ static int apply_frames(struct fsm *f, const struct command_frames *c)
 			f->pending.page_numbers = NULL;
 			f->pending.pages = NULL;
 		} else {
-			rv = VfsApply(vfs, db->path, c->frames.n_pages,
-				      page_numbers, pages);
+			rv = applyCommitted(db, vfs, c->frames.n_pages,
+					    page_numbers, pages);
 			if (rv != 0) {
 				tracef("VfsApply failed %d", rv);
 				sqlite3_free(page_numbers);
@@ -274,7 +721,7 @@ static int apply_frames(struct fsm *f, const struct command_frames *c)
 	}
 
 	sqlite3_free(page_numbers);
-	maybeCheckpoint(db);
+	maybeCheckpoint(f, db);
 	return 0;
 }
 
@@ -313,6 +760,7 @@ static int fsm__apply(struct raft_fsm *fsm,
 {
 	tracef("fsm apply");
 	struct fsm *f = fsm->data;
+	uint64_t start = uv_hrtime();
 	int type;
 	void *command;
 	int rc;
@@ -327,7 +775,7 @@ static int fsm__apply(struct raft_fsm *fsm,
 			rc = apply_open(f, command);
 			break;
 		case COMMAND_FRAMES:
-			rc = apply_frames(f, command);
+			rc = apply_frames(f, command, buf);
 			break;
 		case COMMAND_UNDO:
 			rc = apply_undo(f, command);
@@ -341,6 +789,8 @@ static int fsm__apply(struct raft_fsm *fsm,
 	}
 
 	raft_free(command);
+	dqlite__metrics_latency(&f->registry->metrics.apply,
+				uv_hrtime() - start);
 err:
 	*result = NULL;
 	return rc;
@@ -474,6 +924,7 @@ static int decodeDatabase(struct fsm *f, struct cursor *cursor)
 
 	/* Due to the check above, this cast is safe. */
 	n = (size_t)(header.main_size + header.wal_size);
+	fsm__checkpoint_flush(db);
 	rv = VfsRestore(vfs, db->filename, cursor->p, n);
 	if (rv != 0) {
 		return rv;
@@ -723,6 +1174,7 @@ int fsm__init(struct raft_fsm *fsm,
 
 	f->logger = &config->logger;
 	f->registry = registry;
+	f->raft = NULL;
 	f->pending.n_pages = 0;
 	f->pending.page_numbers = NULL;
 	f->pending.pages = NULL;
@@ -737,6 +1189,12 @@ int fsm__init(struct raft_fsm *fsm,
 	return 0;
 }
 
+void fsm__set_raft(struct raft_fsm *fsm, struct raft *raft)
+{
+	struct fsm *f = fsm->data;
+	f->raft = raft;
+}
+
 void fsm__close(struct raft_fsm *fsm)
 {
 	tracef("fsm close");
@@ -1090,6 +1548,7 @@ static int decodeDiskDatabase(struct fsm *f, struct cursor *cursor)
 	}
 
 	/* Due to the check above, these casts are safe. */
+	fsm__checkpoint_flush(db);
 	rv = VfsDiskRestore(vfs, db->path, cursor->p, (size_t)header.main_size,
 			    (size_t)header.wal_size);
 	if (rv != 0) {
@@ -1147,6 +1606,7 @@ int fsm__init_disk(struct raft_fsm *fsm,
 
 	f->logger = &config->logger;
 	f->registry = registry;
+	f->raft = NULL;
 	f->pending.n_pages = 0;
 	f->pending.page_numbers = NULL;
 	f->pending.pages = NULL;
@@ -25,6 +25,22 @@ int fsm__init_disk(struct raft_fsm *fsm,
 		   struct config *config,
 		   struct registry *registry);
 
+/**
+ * Set the raft instance driving the given FSM. When set, committed frames are
+ * applied by letting the VFS reference the payload of the raft entries, which
+ * stay pinned in the raft log until the next checkpoint. Pinned entries must
+ * be released with VfsReleaseBorrowed() before closing the raft instance.
+ */
+void fsm__set_raft(struct raft_fsm *fsm, struct raft *raft);
+
+/**
+ * Wait for the background checkpoint of the given database to complete, if
+ * one is running, so that the database can be safely accessed from the loop
+ * thread. No new checkpoint is started for the database until the pool
+ * retires the checkpoint work item.
+ */
+void fsm__checkpoint_flush(struct db *db);
+
 void fsm__close(struct raft_fsm *fsm);
 
 #endif /* DQLITE_REPLICATION_METHODS_H_ */
@@ -2,6 +2,7 @@
 
 #include "bind.h"
 #include "conn.h"
+#include "fsm.h"
 #include "id.h"
 #include "lib/threadpool.h"
 #include "protocol.h"
@@ -1195,6 +1196,7 @@ static int handle_dump(struct gateway *g, struct handle *req)
 	uint8_t *wal;
 	size_t n_database;
 	size_t n_wal;
+	struct db *db;
 	int rv;
 	START_V0(dump, files);
 
@@ -1204,6 +1206,10 @@ static int handle_dump(struct gateway *g, struct handle *req)
 	response_files__encode(&response, &cur);
 
 	vfs = sqlite3_vfs_find(g->config->name);
+	db = registry__db_lookup(g->registry, request.filename);
+	if (db != NULL) {
+		fsm__checkpoint_flush(db);
+	}
 	rv = VfsSnapshot(vfs, request.filename, &data, &n);
 	if (rv != 0) {
 		tracef("dump failed");
@@ -1419,6 +1425,104 @@ static int handle_weight(struct gateway *g, struct handle *req)
 	return 0;
 }
 
+/* Encoder of the entries of a metrics response. */
+struct metricsEncoder
+{
+	struct buffer *buffer;
+	uint64_t n; /* Number of entries encoded so far */
+};
+
+static int encodeMetric(void *arg, const char *name, uint64_t value)
+{
+	struct metricsEncoder *e = arg;
+	char *cur;
+
+	cur = buffer__advance(e->buffer, text__sizeof(&name));
+	if (cur == NULL) {
+		return DQLITE_NOMEM;
+	}
+	text__encode(&name, &cur);
+	cur = buffer__advance(e->buffer, uint64__sizeof(&value));
+	if (cur == NULL) {
+		return DQLITE_NOMEM;
+	}
+	uint64__encode(&value, &cur);
+	e->n++;
+	return 0;
+}
+
+static int handle_metrics(struct gateway *g, struct handle *req)
+{
+	tracef("handle metrics");
+	struct cursor *cursor = &req->cursor;
+	struct metricsEncoder e;
+	char name[1024];
+	size_t offset;
+	char *cur;
+	struct db *db;
+	queue *head;
+	int rv;
+	START_V0(metrics, metrics);
+	if (request.format != DQLITE_REQUEST_METRICS_FORMAT_V0) {
+		tracef("bad format");
+		failure(req, SQLITE_PROTOCOL, "bad format version");
+		return 0;
+	}
+
+	/* The header is filled once the number of metrics is known. */
+	offset = buffer__offset(req->buffer);
+	cur = buffer__advance(req->buffer, response_metrics__sizeof(&response));
+	assert(cur != NULL);
+
+	e.buffer = req->buffer;
+	e.n = 0;
+	rv = dqlite__metrics_visit(&g->registry->metrics, encodeMetric, &e);
+	if (rv != 0) {
+		goto err;
+	}
+
+	/* Per-database WAL size, as of the last applied transaction. */
+	QUEUE_FOREACH(head, &g->registry->dbs)
+	{
+		db = QUEUE_DATA(head, struct db, queue);
+		snprintf(name, sizeof name, "wal.%s.frames", db->filename);
+		rv = encodeMetric(&e, name, db->checkpoint.sched.n_frames);
+		if (rv != 0) {
+			goto err;
+		}
+	}
+
+	response.n = e.n;
+	cur = buffer__cursor(req->buffer, offset);
+	response_metrics__encode(&response, &cur);
+	req->cb(req, 0, DQLITE_RESPONSE_METRICS, 0);
+	return 0;
+
+err:
+	tracef("metrics failed %d", rv);
+	failure(req, rv, "failed to encode metrics");
+	return 0;
+}
+
+/* Account for the first response to a request, then hand it over to the
+ * callback passed to gateway__handle(). */
+static void handleCb(struct handle *req,
+		     int status,
+		     uint8_t type,
+		     uint8_t schema)
+{
+	struct gateway *g = req->gw;
+	bool failed;
+
+	if (req->start != 0) {
+		failed = status != 0 || type == DQLITE_RESPONSE_FAILURE;
+		dqlite__metrics_request(&g->registry->metrics, req->type,
+					failed, uv_hrtime() - req->start);
+		req->start = 0;
+	}
+	req->user_cb(req, status, type, schema);
+}
+
 int gateway__handle(struct gateway *g,
 		    struct handle *req,
 		    int type,
@@ -1458,7 +1562,10 @@ int gateway__handle(struct gateway *g,
 handle:
 	req->type = type;
 	req->schema = schema;
-	req->cb = cb;
+	req->cb = handleCb;
+	req->user_cb = cb;
+	req->start = uv_hrtime();
+	req->gw = g;
 	req->buffer = buffer;
 	req->db_id = 0;
 	req->stmt_id = 0;
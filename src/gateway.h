@@ -104,6 +104,12 @@ struct handle {
 	/* Callback that will be invoked at the end of request processing to
 	 * write the response. */
 	handle_cb cb;
+	/* Callback passed to gateway__handle(). The gateway points cb to a
+	 * wrapper that updates the request metrics and then invokes this one. */
+	handle_cb user_cb;
+	/* Time at which the request was received, in nanoseconds. Reset to
+	 * zero once the first response has been accounted for. */
+	uint64_t start;
 	/* A link into thread pool's queues. */
 	pool_work_t work;
 	/* Gateway the handle belongs to. */
@@ -7,6 +7,7 @@
 
 #include "command.h"
 #include "conn.h"
+#include "fsm.h"
 #include "gateway.h"
 #include "id.h"
 #include "leader.h"
@@ -21,6 +22,11 @@
 static void leaderExecDone(struct exec *req)
 {
 	tracef("leader exec done id:%" PRIu64, req->id);
+	struct dqlite__metrics *metrics = req->leader->db->metrics;
+	if (metrics != NULL) {
+		dqlite__metrics_latency(&metrics->exec,
+					uv_hrtime() - req->start);
+	}
 	req->leader->exec = NULL;
 	if (req->cb != NULL) {
 		req->cb(req, req->status);
@@ -133,6 +139,7 @@ int leader__init(struct leader *l, struct db *db, struct raft *raft)
 	int rc;
 	l->db = db;
 	l->raft = raft;
+	fsm__checkpoint_flush(db);
 	rc = openConnection(db->path, db->config->name, db->config->page_size,
 			    &l->conn);
 	if (rc != 0) {
@@ -149,13 +156,26 @@ int leader__init(struct leader *l, struct db *db, struct raft *raft)
 void leader__close(struct leader *l)
 {
 	tracef("leader close");
+	queue *head;
+	queue *next;
 	int rc;
+	/* Forget about barriers waiting for a checkpoint. */
+	for (head = queue_next(&l->db->checkpoint.barriers);
+	     head != &l->db->checkpoint.barriers; head = next) {
+		struct barrier *barrier = QUEUE_DATA(head, struct barrier, queue);
+		next = queue_next(head);
+		if (barrier->leader == l) {
+			queue_remove(head);
+			queue_init(head);
+		}
+	}
 	/* TODO: there shouldn't be any ongoing exec request. */
 	if (l->exec != NULL) {
 		assert(l->inflight == NULL);
 		l->exec->status = SQLITE_ERROR;
 		leaderExecDone(l->exec);
 	}
+	fsm__checkpoint_flush(l->db);
 	rc = sqlite3_close(l->conn);
 	assert(rc == 0);
 
@@ -255,6 +275,11 @@ static void leaderApplyFramesCb(struct raft_apply *req,
 
 	(void)result;
 
+	if (status == 0 && l->db->metrics != NULL) {
+		dqlite__metrics_latency(&l->db->metrics->commit,
+					uv_hrtime() - apply->start);
+	}
+
 	if (status != 0) {
 		tracef("apply frames cb failed status %d", status);
 		sqlite3_vfs *vfs = sqlite3_vfs_find(l->db->config->name);
@@ -298,9 +323,8 @@ finish:
 	leaderExecDone(l->exec);
 }
 
-static int leaderApplyFrames(struct exec *req,
-			     dqlite_vfs_frame *frames,
-			     unsigned n)
+/* Replicate the n frames of the transaction pending in the VFS. */
+static int leaderApplyFrames(struct exec *req, sqlite3_vfs *vfs, unsigned n)
 {
 	tracef("leader apply frames id:%" PRIu64, req->id);
 	struct leader *l = req->leader;
@@ -308,6 +332,8 @@ static int leaderApplyFrames(struct exec *req,
 	struct command_frames c;
 	struct raft_buffer buf;
 	struct apply *apply;
+	void *page_numbers;
+	void *pages;
 	int rv;
 
 	c.filename = db->filename;
@@ -316,7 +342,7 @@ static int leaderApplyFrames(struct exec *req,
 	c.is_commit = 1;
 	c.frames.n_pages = (uint32_t)n;
 	c.frames.page_size = (uint16_t)db->config->page_size;
-	c.frames.data = frames;
+	c.frames.data = NULL;
 
 	apply = raft_malloc(sizeof *req);
 	if (apply == NULL) {
@@ -325,15 +351,23 @@ static int leaderApplyFrames(struct exec *req,
 		goto err;
 	}
 
-	rv = command__encode(COMMAND_FRAMES, &c, &buf);
+	rv = command_frames__encode_in_place(&c, &buf, &page_numbers, &pages);
 	if (rv != 0) {
 		tracef("encode %d", rv);
 		goto err_after_apply_alloc;
 	}
 
+	/* Have the VFS copy the frames straight into the entry buffer. */
+	rv = VfsPollInto(vfs, db->path, n, page_numbers, pages);
+	if (rv != 0) {
+		tracef("vfs poll into %d", rv);
+		goto err_after_command_encode;
+	}
+
 	apply->leader = req->leader;
 	apply->req.data = apply;
 	apply->type = COMMAND_FRAMES;
+	apply->start = uv_hrtime();
 	idSet(apply->req.req_id, req->id);
 
 #ifdef USE_SYSTEM_RAFT
@@ -368,10 +402,8 @@ static void leaderExecV2(struct exec *req, enum pool_half half)
 	struct leader *l = req->leader;
 	struct db *db = l->db;
 	sqlite3_vfs *vfs = sqlite3_vfs_find(db->config->name);
-	dqlite_vfs_frame *frames;
 	uint64_t size;
 	unsigned n;
-	unsigned i;
 	int rv;
 
 	if (half == POOL_TOP_HALF) {
@@ -379,7 +411,7 @@ static void leaderExecV2(struct exec *req, enum pool_half half)
 		return;
 	} /* else POOL_BOTTOM_HALF => */
 
-	rv = VfsPoll(vfs, db->path, &frames, &n);
+	rv = VfsPollCount(vfs, db->path, &n);
 	if (rv != 0 || n == 0) {
 		tracef("vfs poll");
 		goto finish;
@@ -392,22 +424,14 @@ static void leaderExecV2(struct exec *req, enum pool_half half)
 		goto abort;
 	}
 
-	rv = leaderApplyFrames(req, frames, n);
+	rv = leaderApplyFrames(req, vfs, n);
 	if (rv != 0) {
 		goto abort;
 	}
 
-	for (i = 0; i < n; i++) {
-		sqlite3_free(frames[i].data);
-	}
-	sqlite3_free(frames);
 	return;
 
 abort:
-	for (i = 0; i < n; i++) {
-		sqlite3_free(frames[i].data);
-	}
-	sqlite3_free(frames);
 	VfsAbort(vfs, l->db->path);
 finish:
 	if (rv != 0) {
@@ -422,12 +446,19 @@ finish:
 static void exec_top(pool_work_t *w)
 {
 	struct exec *req = CONTAINER_OF(w, struct exec, work);
+	/* Turn the queueing time into a wait time, which is accounted for by
+	 * the bottom half on the loop thread. */
+	req->queued = uv_hrtime() - req->queued;
 	leaderExecV2(req, POOL_TOP_HALF);
 }
 
 static void exec_bottom(pool_work_t *w)
 {
 	struct exec *req = CONTAINER_OF(w, struct exec, work);
+	struct dqlite__metrics *metrics = req->leader->db->metrics;
+	if (metrics != NULL) {
+		dqlite__metrics_latency(&metrics->pool_wait, req->queued);
+	}
 	leaderExecV2(req, POOL_BOTTOM_HALF);
 }
 
@@ -449,6 +480,7 @@ static void execBarrierCb(struct barrier *barrier, int status)
 	struct dqlite_node *node = l->raft->data;
 	pool_t *pool = !!(pool_ut_fallback()->flags & POOL_FOR_UT)
 		? pool_ut_fallback() : &node->pool;
+	req->queued = uv_hrtime();
 	pool_queue_work(pool, &req->work, l->db->cookie,
 			WT_UNORD, exec_top, exec_bottom);
 #else
@@ -475,6 +507,7 @@ int leader__exec(struct leader *l,
 	req->stmt = stmt;
 	req->id = id;
 	req->cb = cb;
+	req->start = uv_hrtime();
 	req->barrier.data = req;
 	req->barrier.cb = NULL;
 	req->work = (pool_work_t){};
@@ -492,6 +525,8 @@ static void raftBarrierCb(struct raft_barrier *req, int status)
 	tracef("raft barrier cb status %d", status);
 	struct barrier *barrier = req->data;
 	int rv = 0;
+	queue_remove(&barrier->queue);
+	queue_init(&barrier->queue);
 	if (status != 0) {
 		if (status == RAFT_LEADERSHIPLOST) {
 			rv = SQLITE_IOERR_LEADERSHIP_LOST;
@@ -512,6 +547,16 @@ int leader__barrier(struct leader *l, struct barrier *barrier, barrier_cb cb)
 {
 	tracef("leader barrier");
 	int rv;
+	queue_init(&barrier->queue);
+	if (l->db->checkpoint.state == DB_CHECKPOINT_RUNNING) {
+		tracef("wait for checkpoint");
+		barrier->cb = cb;
+		barrier->leader = l;
+		barrier->req.data = barrier;
+		barrier->req.cb = raftBarrierCb;
+		queue_insert_tail(&l->db->checkpoint.barriers, &barrier->queue);
+		return 0;
+	}
 	if (!needsBarrier(l)) {
 		tracef("not needed");
 		cb(barrier, 0);
@@ -530,3 +575,24 @@ int leader__barrier(struct leader *l, struct barrier *barrier, barrier_cb cb)
 	}
 	return 0;
 }
+
+void leader__resume_barriers(struct db *db)
+{
+	while (!queue_empty(&db->checkpoint.barriers)) {
+		struct barrier *barrier;
+		barrier_cb cb;
+		queue *head = queue_head(&db->checkpoint.barriers);
+		int rv;
+		queue_remove(head);
+		queue_init(head);
+		barrier = QUEUE_DATA(head, struct barrier, queue);
+		cb = barrier->cb;
+		barrier->cb = NULL;
+		rv = leader__barrier(barrier->leader, barrier, cb);
+		if (rv != 0) {
+			barrier->cb = cb;
+			barrier->req.data = barrier;
+			raftBarrierCb(&barrier->req, rv);
+		}
+	}
+}
@@ -29,6 +29,7 @@ struct apply {
 	int status;            /* Raft apply result */
 	struct leader *leader; /* Leader connection that triggered the hook */
 	int type;              /* Command type */
+	uint64_t start;        /* Submission time, in nanoseconds */
 	union {                /* Command-specific data */
 		struct {
 			bool is_commit;
@@ -50,6 +51,7 @@ struct barrier {
 	struct leader *leader;
 	struct raft_barrier req;
 	barrier_cb cb;
+	queue queue; /* Used by struct db while a checkpoint is running. */
 };
 
 /**
@@ -65,6 +67,8 @@ struct exec {
 	queue queue;
 	exec_cb cb;
 	pool_work_t work;
+	uint64_t start;  /* Submission time, in nanoseconds */
+	uint64_t queued; /* Time the work was queued to the thread pool */
 };
 
 /**
@@ -107,4 +111,10 @@ int leader__exec(struct leader *l,
  */
 int leader__barrier(struct leader *l, struct barrier *barrier, barrier_cb cb);
 
+/**
+ * Resubmit the barrier requests that were held back while a background
+ * checkpoint of the given database was running.
+ */
+void leader__resume_barriers(struct db *db);
+
 #endif /* LEADER_H_*/
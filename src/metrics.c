@@ -1,13 +1,363 @@
+#include <inttypes.h>
+#include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+
+#include "../include/dqlite.h"
 
 #include "./lib/assert.h"
 
 #include "metrics.h"
+#include "protocol.h"
+#include "request.h"
+
+/* Maximum length of a metric name. */
+#define METRICS__NAME_LEN 128
+
+void dqlite__histogram_init(struct dqlite__histogram *h)
+{
+	h->count = 0;
+	h->sum = 0;
+	h->max = 0;
+	memset(h->buckets, 0, sizeof h->buckets);
+}
+
+unsigned dqlite__histogram_bucket(uint64_t value)
+{
+	unsigned msb;
+	unsigned shift;
+	unsigned i;
+
+	if (value < DQLITE__HISTOGRAM_SUB) {
+		return (unsigned)value;
+	}
+
+	msb = 63 - (unsigned)__builtin_clzll(value);
+	shift = msb - DQLITE__HISTOGRAM_SUB_BITS;
+	i = (shift + 1) * DQLITE__HISTOGRAM_SUB +
+	    (unsigned)((value >> shift) & (DQLITE__HISTOGRAM_SUB - 1));
+
+	return i < DQLITE__HISTOGRAM_N_BUCKETS ? i
+					       : DQLITE__HISTOGRAM_N_BUCKETS - 1;
+}
+
+uint64_t dqlite__histogram_lower(unsigned i)
+{
+	unsigned shift;
+
+	assert(i < DQLITE__HISTOGRAM_N_BUCKETS);
+
+	if (i < DQLITE__HISTOGRAM_SUB) {
+		return i;
+	}
+	shift = i / DQLITE__HISTOGRAM_SUB - 1;
+	return (uint64_t)(DQLITE__HISTOGRAM_SUB + i % DQLITE__HISTOGRAM_SUB)
+	       << shift;
+}
+
+uint64_t dqlite__histogram_upper(unsigned i)
+{
+	if (i == DQLITE__HISTOGRAM_N_BUCKETS - 1) {
+		return UINT64_MAX;
+	}
+	return dqlite__histogram_lower(i + 1) - 1;
+}
+
+void dqlite__histogram_record(struct dqlite__histogram *h, uint64_t value)
+{
+	h->count++;
+	h->sum += value;
+	if (value > h->max) {
+		h->max = value;
+	}
+	h->buckets[dqlite__histogram_bucket(value)]++;
+}
+
+uint64_t dqlite__histogram_percentile(const struct dqlite__histogram *h,
+				      unsigned permille)
+{
+	uint64_t rank;
+	uint64_t seen = 0;
+	uint64_t upper;
+	unsigned i;
+
+	assert(permille <= 1000);
+
+	if (h->count == 0) {
+		return 0;
+	}
+
+	rank = (h->count * permille + 999) / 1000;
+	if (rank == 0) {
+		rank = 1;
+	}
+
+	for (i = 0; i < DQLITE__HISTOGRAM_N_BUCKETS; i++) {
+		seen += h->buckets[i];
+		if (seen >= rank) {
+			upper = dqlite__histogram_upper(i);
+			return upper < h->max ? upper : h->max;
+		}
+	}
+
+	return h->max;
+}
 
 void dqlite__metrics_init(struct dqlite__metrics *m)
 {
+	unsigned i;
+
 	assert(m != NULL);
 
 	m->requests = 0;
 	m->duration = 0;
+	for (i = 0; i < DQLITE__METRICS_N_REQUEST_TYPES; i++) {
+		m->request[i].failures = 0;
+		dqlite__histogram_init(&m->request[i].latency);
+	}
+	m->bytes_in = 0;
+	m->bytes_out = 0;
+	dqlite__histogram_init(&m->exec);
+	dqlite__histogram_init(&m->pool_wait);
+	dqlite__histogram_init(&m->commit);
+	dqlite__histogram_init(&m->apply);
+	m->checkpoints = 0;
+	m->checkpoint_frames = 0;
+	m->checkpoint_duration = 0;
+	m->checkpoint_duration_max = 0;
+	memset(m->checkpoint_deferred, 0, sizeof m->checkpoint_deferred);
+	m->checkpoint_deferred_frames = 0;
+	memset(m->checkpoint_decisions, 0, sizeof m->checkpoint_decisions);
+}
+
+void dqlite__metrics_checkpoint(struct dqlite__metrics *m,
+				unsigned n_frames,
+				uint64_t duration)
+{
+	assert(m != NULL);
+
+	m->checkpoints++;
+	m->checkpoint_frames += n_frames;
+	m->checkpoint_deferred_frames = 0;
+	m->checkpoint_duration += duration;
+	if (duration > m->checkpoint_duration_max) {
+		m->checkpoint_duration_max = duration;
+	}
+}
+
+void dqlite__metrics_checkpoint_deferred(struct dqlite__metrics *m,
+					 int reason,
+					 unsigned n_frames)
+{
+	assert(m != NULL);
+	assert(reason >= 0 && reason < DQLITE__CHECKPOINT_N_REASONS);
+
+	m->checkpoint_deferred[reason]++;
+	m->checkpoint_deferred_frames = n_frames;
+}
+
+void dqlite__metrics_checkpoint_decision(struct dqlite__metrics *m,
+					 int decision)
+{
+	assert(m != NULL);
+	assert(decision >= 0 && decision < CHECKPOINT_N_DECISIONS);
+
+	m->checkpoint_decisions[decision]++;
+}
+
+void dqlite__metrics_request(struct dqlite__metrics *m,
+			     int type,
+			     bool failed,
+			     uint64_t duration)
+{
+	struct dqlite__request_metrics *r;
+
+	assert(m != NULL);
+
+	m->requests++;
+	m->duration += duration;
+
+	if (type < 0 || type >= DQLITE__METRICS_N_REQUEST_TYPES) {
+		return;
+	}
+	r = &m->request[type];
+	if (failed) {
+		r->failures++;
+	}
+	dqlite__metrics_latency(&r->latency, duration);
+}
+
+void dqlite__metrics_bytes_in(struct dqlite__metrics *m, uint64_t n)
+{
+	assert(m != NULL);
+	m->bytes_in += n;
+}
+
+void dqlite__metrics_bytes_out(struct dqlite__metrics *m, uint64_t n)
+{
+	assert(m != NULL);
+	m->bytes_out += n;
+}
+
+void dqlite__metrics_latency(struct dqlite__histogram *h, uint64_t duration)
+{
+	dqlite__histogram_record(h, duration / 1000);
+}
+
+/* Invoke the visitor callback with a name made of the given prefix and
+ * suffix. */
+static int visit(dqlite__metrics_visit_cb cb,
+		 void *arg,
+		 const char *prefix,
+		 const char *suffix,
+		 uint64_t value)
+{
+	char name[METRICS__NAME_LEN];
+	int rv;
+
+	rv = snprintf(name, sizeof name, "%s%s", prefix, suffix);
+	if (rv < 0 || (size_t)rv >= sizeof name) {
+		return DQLITE_ERROR;
+	}
+	return cb(arg, name, value);
+}
+
+static int visitHistogram(dqlite__metrics_visit_cb cb,
+			  void *arg,
+			  const char *prefix,
+			  const struct dqlite__histogram *h)
+{
+	static const struct
+	{
+		const char *suffix;
+		unsigned permille;
+	} percentiles[] = {
+		{ ".p50", 500 },
+		{ ".p90", 900 },
+		{ ".p99", 990 },
+		{ ".p999", 999 },
+	};
+	char suffix[METRICS__NAME_LEN];
+	unsigned i;
+	int rv;
+
+	rv = visit(cb, arg, prefix, ".count", h->count);
+	if (rv != 0) {
+		return rv;
+	}
+	rv = visit(cb, arg, prefix, ".sum", h->sum);
+	if (rv != 0) {
+		return rv;
+	}
+	rv = visit(cb, arg, prefix, ".max", h->max);
+	if (rv != 0) {
+		return rv;
+	}
+	for (i = 0; i < sizeof percentiles / sizeof *percentiles; i++) {
+		rv = visit(cb, arg, prefix, percentiles[i].suffix,
+			   dqlite__histogram_percentile(
+			       h, percentiles[i].permille));
+		if (rv != 0) {
+			return rv;
+		}
+	}
+	for (i = 0; i < DQLITE__HISTOGRAM_N_BUCKETS; i++) {
+		if (h->buckets[i] == 0) {
+			continue;
+		}
+		if (i == DQLITE__HISTOGRAM_N_BUCKETS - 1) {
+			snprintf(suffix, sizeof suffix, ".bucket.inf");
+		} else {
+			snprintf(suffix, sizeof suffix, ".bucket.%" PRIu64,
+				 dqlite__histogram_upper(i));
+		}
+		rv = visit(cb, arg, prefix, suffix, h->buckets[i]);
+		if (rv != 0) {
+			return rv;
+		}
+	}
+
+	return 0;
+}
+
+static int visitRequest(dqlite__metrics_visit_cb cb,
+			void *arg,
+			const char *name,
+			const struct dqlite__request_metrics *r)
+{
+	char prefix[METRICS__NAME_LEN];
+	int rv;
+
+	if (r->latency.count == 0) {
+		return 0;
+	}
+
+	snprintf(prefix, sizeof prefix, "request.%s", name);
+	rv = visit(cb, arg, prefix, ".failures", r->failures);
+	if (rv != 0) {
+		return rv;
+	}
+	snprintf(prefix, sizeof prefix, "request.%s.latency_us", name);
+	return visitHistogram(cb, arg, prefix, &r->latency);
+}
+
+int dqlite__metrics_visit(const struct dqlite__metrics *m,
+			  dqlite__metrics_visit_cb cb,
+			  void *arg)
+{
+	static const char *reasons[DQLITE__CHECKPOINT_N_REASONS] = {
+		[DQLITE__CHECKPOINT_READER] = ".reader",
+		[DQLITE__CHECKPOINT_WRITER] = ".writer",
+	};
+	char suffix[METRICS__NAME_LEN];
+	int i;
+	int rv;
+
+#define VISIT(PREFIX, SUFFIX, VALUE)                       \
+	rv = visit(cb, arg, PREFIX, SUFFIX, VALUE);       \
+	if (rv != 0) {                                     \
+		return rv;                                 \
+	}
+#define VISIT_HISTOGRAM(PREFIX, H)                         \
+	rv = visitHistogram(cb, arg, PREFIX, H);           \
+	if (rv != 0) {                                     \
+		return rv;                                 \
+	}
+#define VISIT_REQUEST(LOWER, UPPER, _)                                 \
+	rv = visitRequest(cb, arg, #LOWER,                             \
+			  &m->request[DQLITE_REQUEST_##UPPER]);        \
+	if (rv != 0) {                                                 \
+		return rv;                                             \
+	}
+
+	VISIT("requests", "", m->requests);
+	VISIT("duration_ns", "", m->duration);
+	VISIT("bytes_in", "", m->bytes_in);
+	VISIT("bytes_out", "", m->bytes_out);
+	REQUEST__TYPES(VISIT_REQUEST);
+	VISIT_HISTOGRAM("exec.latency_us", &m->exec);
+	VISIT_HISTOGRAM("exec.pool_wait_us", &m->pool_wait);
+	VISIT_HISTOGRAM("raft.commit_latency_us", &m->commit);
+	VISIT_HISTOGRAM("fsm.apply_latency_us", &m->apply);
+	VISIT("checkpoint.count", "", m->checkpoints);
+	VISIT("checkpoint.frames", "", m->checkpoint_frames);
+	VISIT("checkpoint.duration_ns", "", m->checkpoint_duration);
+	VISIT("checkpoint.duration_max_ns", "", m->checkpoint_duration_max);
+	for (i = 0; i < DQLITE__CHECKPOINT_N_REASONS; i++) {
+		VISIT("checkpoint.deferred", reasons[i],
+		      m->checkpoint_deferred[i]);
+	}
+	VISIT("checkpoint.deferred_frames", "", m->checkpoint_deferred_frames);
+	for (i = 0; i < CHECKPOINT_N_DECISIONS; i++) {
+		snprintf(suffix, sizeof suffix, ".%s",
+			 checkpoint_sched__decision_name(i));
+		VISIT("checkpoint.decision", suffix,
+		      m->checkpoint_decisions[i]);
+	}
+
+#undef VISIT_REQUEST
+#undef VISIT_HISTOGRAM
+#undef VISIT
+
+	return 0;
 }
@@ -7,14 +7,133 @@
 #ifndef DQLITE_METRICS_H
 #define DQLITE_METRICS_H
 
+#include <stdbool.h>
 #include <stdint.h>
 
+#include "checkpoint.h"
+
+/* Latencies are recorded in HDR-style log-linear histograms, in microseconds.
+ * Values below 16 get a bucket each, larger values are split into powers of
+ * two, each further split into 2^DQLITE__HISTOGRAM_SUB_BITS linear buckets, so
+ * that the relative error is at most 1/8. Values of 2^32 microseconds (about
+ * 71 minutes) or more all fall in the last bucket. */
+#define DQLITE__HISTOGRAM_SUB_BITS 3
+#define DQLITE__HISTOGRAM_SUB (1 << DQLITE__HISTOGRAM_SUB_BITS)
+#define DQLITE__HISTOGRAM_N_BUCKETS \
+	((32 - DQLITE__HISTOGRAM_SUB_BITS + 1) * DQLITE__HISTOGRAM_SUB)
+
+/* Upper bound on the request type codes that get their own metrics. */
+#define DQLITE__METRICS_N_REQUEST_TYPES 32
+
+/* Reasons for a checkpoint to leave frames in the WAL. */
+enum {
+	DQLITE__CHECKPOINT_READER, /* Readers still need some frames. */
+	DQLITE__CHECKPOINT_WRITER, /* A write transaction is in progress. */
+	DQLITE__CHECKPOINT_N_REASONS
+};
+
+struct dqlite__histogram
+{
+	uint64_t count; /* Number of recorded values. */
+	uint64_t sum;   /* Sum of the recorded values. */
+	uint64_t max;   /* Largest recorded value. */
+	uint64_t buckets[DQLITE__HISTOGRAM_N_BUCKETS];
+};
+
+/* Metrics of a single request type. */
+struct dqlite__request_metrics
+{
+	uint64_t failures;                /* Requests that got a failure. */
+	struct dqlite__histogram latency; /* Time to the first response. */
+};
+
 struct dqlite__metrics
 {
 	uint64_t requests; /* Total number of requests served. */
-	uint64_t duration; /* Total time spent to server requests. */
+	uint64_t duration; /* Total time spent to server requests, in ns. */
+	struct dqlite__request_metrics request[DQLITE__METRICS_N_REQUEST_TYPES];
+	uint64_t bytes_in;  /* Bytes received from clients. */
+	uint64_t bytes_out; /* Bytes sent to clients. */
+	struct dqlite__histogram exec;      /* Leader exec requests. */
+	struct dqlite__histogram pool_wait; /* Queueing of exec work. */
+	struct dqlite__histogram commit;    /* Raft apply to commit. */
+	struct dqlite__histogram apply;     /* FSM commands. */
+	uint64_t checkpoints;             /* Number of WAL checkpoints. */
+	uint64_t checkpoint_frames;       /* Total frames checkpointed. */
+	uint64_t checkpoint_duration;     /* Total checkpoint time, in ns. */
+	uint64_t checkpoint_duration_max; /* Slowest checkpoint, in ns. */
+	/* Number of checkpoints that left frames in the WAL, by reason, and
+	 * number of frames left behind by the last one. */
+	uint64_t checkpoint_deferred[DQLITE__CHECKPOINT_N_REASONS];
+	uint64_t checkpoint_deferred_frames;
+	/* Number of times the checkpoint scheduler took each decision. */
+	uint64_t checkpoint_decisions[CHECKPOINT_N_DECISIONS];
 };
 
+void dqlite__histogram_init(struct dqlite__histogram *h);
+
+/* Record a value in the histogram. */
+void dqlite__histogram_record(struct dqlite__histogram *h, uint64_t value);
+
+/* Index of the bucket holding the given value. */
+unsigned dqlite__histogram_bucket(uint64_t value);
+
+/* Smallest and largest value held by the i'th bucket. */
+uint64_t dqlite__histogram_lower(unsigned i);
+uint64_t dqlite__histogram_upper(unsigned i);
+
+/* Estimate the value below which the given fraction of the recorded values
+ * fall, expressed in thousandths. */
+uint64_t dqlite__histogram_percentile(const struct dqlite__histogram *h,
+				      unsigned permille);
+
 void dqlite__metrics_init(struct dqlite__metrics *m);
 
+/* Account for a request of the given type whose first response took the
+ * given number of nanoseconds. */
+void dqlite__metrics_request(struct dqlite__metrics *m,
+			     int type,
+			     bool failed,
+			     uint64_t duration);
+
+/* Account for traffic with clients. */
+void dqlite__metrics_bytes_in(struct dqlite__metrics *m, uint64_t n);
+void dqlite__metrics_bytes_out(struct dqlite__metrics *m, uint64_t n);
+
+/* Record the given duration, in nanoseconds, in one of the latency
+ * histograms. */
+void dqlite__metrics_latency(struct dqlite__histogram *h, uint64_t duration);
+
+/* Account for a checkpoint of n_frames WAL frames that took the given number
+ * of nanoseconds. */
+void dqlite__metrics_checkpoint(struct dqlite__metrics *m,
+				unsigned n_frames,
+				uint64_t duration);
+
+/* Account for a checkpoint that had to leave n_frames WAL frames behind for
+ * the given reason. */
+void dqlite__metrics_checkpoint_deferred(struct dqlite__metrics *m,
+					 int reason,
+					 unsigned n_frames);
+
+/* Account for a decision of the checkpoint scheduler. */
+void dqlite__metrics_checkpoint_decision(struct dqlite__metrics *m,
+					 int decision);
+
+/* Invoked once for every metric, with a dotted name. */
+typedef int (*dqlite__metrics_visit_cb)(void *arg,
+					const char *name,
+					uint64_t value);
+
+/* Invoke the given callback for every metric, in a stable order, and stop at
+ * the first non-zero return value.
+ *
+ * Histograms are flattened into <name>.count, <name>.sum, <name>.max, a few
+ * percentiles like <name>.p99, and one <name>.bucket.<upper> entry for every
+ * non-empty bucket, holding the number of values between the upper bound of
+ * the previous bucket and <upper>. */
+int dqlite__metrics_visit(const struct dqlite__metrics *m,
+			  dqlite__metrics_visit_cb cb,
+			  void *arg);
+
 #endif /* DQLITE_METRICS_H */
@@ -47,7 +47,8 @@ enum {
 	DQLITE_REQUEST_CLUSTER,
 	DQLITE_REQUEST_TRANSFER,
 	DQLITE_REQUEST_DESCRIBE,
-	DQLITE_REQUEST_WEIGHT
+	DQLITE_REQUEST_WEIGHT,
+	DQLITE_REQUEST_METRICS
 };
 
 #define DQLITE_REQUEST_CLUSTER_FORMAT_V0 0 /* ID and address */
@@ -55,6 +56,8 @@ enum {
 
 #define DQLITE_REQUEST_DESCRIBE_FORMAT_V0 0 /* Failure domain and weight */
 
+#define DQLITE_REQUEST_METRICS_FORMAT_V0 0 /* Name and value pairs */
+
 /* These apply to REQUEST_EXEC, REQUEST_EXEC_SQL, REQUEST_QUERY, and
  * REQUEST_QUERY_SQL. */
 #define DQLITE_REQUEST_PARAMS_SCHEMA_V0 0 /* One-byte params count */
@@ -81,7 +84,8 @@ enum {
 	DQLITE_RESPONSE_ROWS,
 	DQLITE_RESPONSE_EMPTY,
 	DQLITE_RESPONSE_FILES,
-	DQLITE_RESPONSE_METADATA
+	DQLITE_RESPONSE_METADATA,
+	DQLITE_RESPONSE_METRICS
 };
 
 #endif /* DQLITE_PROTOCOL_H_ */
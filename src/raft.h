@@ -1123,6 +1123,27 @@ RAFT_API int raft_apply(struct raft *r,
 			const unsigned n,
 			raft_apply_cb cb);
 
+/**
+ * Acquire a reference to the entry at the given @index, which must still be in
+ * the in-memory log (for example the entry whose payload is being passed to
+ * the apply callback of the FSM, at index raft_last_applied() + 1).
+ *
+ * The memory pointed at by the @buf attribute of the returned entry stays
+ * valid even after the entry gets deleted from the log, for example by a
+ * snapshot, until raft_entry_release() is called. All acquired entries must be
+ * released before raft_close() is called.
+ */
+RAFT_API int raft_entry_acquire(struct raft *r,
+				raft_index index,
+				struct raft_entry **entry);
+
+/**
+ * Release an entry previously acquired with raft_entry_acquire().
+ */
+RAFT_API void raft_entry_release(struct raft *r,
+				 raft_index index,
+				 struct raft_entry *entry);
+
 /**
  * Asynchronous request to append a barrier entry.
  */
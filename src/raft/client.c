@@ -114,6 +114,24 @@ err:
 	return rv;
 }
 
+int raft_entry_acquire(struct raft *r,
+		       raft_index index,
+		       struct raft_entry **entry)
+{
+	assert(r != NULL);
+	assert(entry != NULL);
+	return logAcquireEntry(r->log, index, entry);
+}
+
+void raft_entry_release(struct raft *r,
+			raft_index index,
+			struct raft_entry *entry)
+{
+	assert(r != NULL);
+	assert(entry != NULL);
+	logRelease(r->log, index, entry, 1);
+}
+
 static int clientChangeConfiguration(
     struct raft *r,
     struct raft_change *req,
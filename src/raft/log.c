@@ -791,19 +791,48 @@ int logAcquire(struct raft_log *l,
 	return 0;
 }
 
+int logAcquireEntry(struct raft_log *l,
+		    const raft_index index,
+		    struct raft_entry *entries[])
+{
+	size_t i;
+
+	assert(l != NULL);
+	assert(index > 0);
+	assert(entries != NULL);
+
+	i = locateEntry(l, index);
+	if (i == l->size) {
+		*entries = NULL;
+		return RAFT_NOTFOUND;
+	}
+
+	*entries = raft_malloc(sizeof **entries);
+	if (*entries == NULL) {
+		return RAFT_NOMEM;
+	}
+	**entries = l->entries[i];
+	refsIncr(l, (*entries)->term, index);
+
+	return 0;
+}
+
 /* Return true if the given batch is referenced by any entry currently in the
- * log. */
+ * log, or by any entry that was deleted from the log but is still acquired. */
 static bool isBatchReferenced(struct raft_log *l, const void *batch)
 {
 	size_t i;
 
-	/* Iterate through all live entries to see if there's one
-	 * belonging to the same batch. This is slightly inefficient but
-	 * this code path should be taken very rarely in practice. */
-	for (i = 0; i < logNumEntries(l); i++) {
-		struct raft_entry *entry = entryAt(l, i);
-		if (entry->batch == batch) {
-			return true;
+	/* Every live or acquired entry has a reference count slot, so iterate
+	 * through all of them to see if there's one belonging to the same
+	 * batch. This is slightly inefficient but this code path should be
+	 * taken very rarely in practice. */
+	for (i = 0; i < l->refs_size; i++) {
+		struct raft_entry_ref *slot;
+		for (slot = &l->refs[i]; slot != NULL; slot = slot->next) {
+			if (slot->count > 0 && slot->batch == batch) {
+				return true;
+			}
 		}
 	}
 
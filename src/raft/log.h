@@ -138,6 +138,13 @@ int logAcquire(struct raft_log *l,
 	       struct raft_entry *entries[],
 	       unsigned *n);
 
+/* Acquire only the entry at the given index, which must be in the log. The
+ * returned array holds a single entry and must be released with logRelease().
+ * If there's no entry at the given index, RAFT_NOTFOUND is returned. */
+int logAcquireEntry(struct raft_log *l,
+		    raft_index index,
+		    struct raft_entry *entries[]);
+
 /* Release a previously acquired array of entries. */
 void logRelease(struct raft_log *l,
 		raft_index index,
@@ -66,6 +66,7 @@ struct uv
 	bool errored;                        /* If a disk I/O error was hit */
 	bool direct_io;                 /* Whether direct I/O is supported */
 	bool async_io;                  /* Whether async I/O is supported */
+	bool uring_io;                  /* Whether to write with io_uring */
 	bool fallocate;                 /* Whether fallocate is supported */
 	size_t segment_size;            /* Initial size of open segments. */
 	size_t block_size;              /* Block size of the data dir */
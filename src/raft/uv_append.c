@@ -436,7 +436,7 @@ static int uvAliveSegmentReady(struct uv *uv,
 {
 	int rv;
 	rv = UvWriterInit(&segment->writer, uv->loop, fd, uv->direct_io,
-			  uv->async_io, 1, uv->io->errmsg);
+			  uv->async_io, uv->uring_io, 1, uv->io->errmsg);
 	if (rv != 0) {
 		ErrMsgWrapf(uv->io->errmsg, "setup writer for open-%llu",
 			    counter);
@@ -10,6 +10,7 @@
 #include "err.h"
 #include "heap.h"
 #include "uv_os.h"
+#include "uv_uring.h"
 
 int UvFsCheckDir(const char *dir, char *errmsg)
 {
@@ -189,6 +190,7 @@ int UvFsAllocateFile(const char *dir,
 		     size_t size,
 		     uv_file *fd,
 		     bool fallocate,
+		     bool dsync,
 		     char *errmsg)
 {
 	char path[UV__PATH_SZ];
@@ -203,7 +205,9 @@ int UvFsAllocateFile(const char *dir,
 	/* Allocate the desired size. */
 	if (fallocate) {
 		/* TODO: use RWF_DSYNC instead, if available. */
-		flags |= O_DSYNC;
+		if (dsync) {
+			flags |= O_DSYNC;
+		}
 		rv = uvFsOpenFile(dir, filename, flags, S_IRUSR | S_IWUSR, fd,
 				  errmsg);
 		if (rv != 0) {
@@ -249,14 +253,17 @@ int UvFsAllocateFile(const char *dir,
 			rv = RAFT_IOERR;
 			goto err_after_open;
 		}
-		/* Now close and reopen the file with O_DSYNC */
+		/* Now close and reopen the file, with O_DSYNC if requested */
 		rv = UvOsClose(*fd);
 		if (rv != 0) {
 			ErrMsgPrintf(errmsg, "close %d", rv);
 			goto err_unlink;
 		}
 		/* TODO: use RWF_DSYNC instead, if available. */
-		flags = O_WRONLY | O_DSYNC;
+		flags = O_WRONLY;
+		if (dsync) {
+			flags |= O_DSYNC;
+		}
 		rv = uvFsOpenFile(dir, filename, flags, S_IRUSR | S_IWUSR, fd,
 				  errmsg);
 		if (rv != 0) {
@@ -839,6 +846,60 @@ static int probeAsyncIO(int fd, size_t size, bool *ok, char *errmsg)
 	return 0;
 }
 
+/* Check if a write linked to a fdatasync() can be performed with io_uring. Any
+ * failure just means that io_uring can't be used. */
+static void probeIoUring(int fd, size_t size, bool *ok)
+{
+	struct UvUring ring;
+	uv_buf_t buf;
+	uint64_t data;
+	unsigned n;
+	int res;
+	int rv;
+
+	*ok = false;
+
+	rv = UvUringInit(&ring, 2);
+	if (rv != 0) {
+		return;
+	}
+	rv = UvUringRegisterFile(&ring, fd);
+	if (rv != 0) {
+		goto out;
+	}
+
+	buf.len = size;
+	buf.base = raft_aligned_alloc(size, size);
+	if (buf.base == NULL) {
+		goto out;
+	}
+	memset(buf.base, 0, size);
+
+	rv = UvUringPrepWriteSync(&ring, &buf, 1, false, 0, 1, 2);
+	assert(rv == 0);
+	rv = UvUringSubmit(&ring, 2);
+	if (rv != 0) {
+		goto out_after_alloc;
+	}
+
+	*ok = true;
+	for (n = 0; n < 2; n++) {
+		if (!UvUringPeek(&ring, &data, &res)) {
+			/* UNTESTED: we waited for both completions. */
+			*ok = false;
+			break;
+		}
+		if (res < 0 || (data == 1 && (size_t)res != size)) {
+			*ok = false;
+		}
+	}
+
+out_after_alloc:
+	raft_aligned_free(size, buf.base);
+out:
+	UvUringClose(&ring);
+}
+
 #define UV__FS_PROBE_FALLOCATE_FILE ".probe_fallocate"
 /* Leave detection of other error conditions to other probe* functions, only
  * bother checking if posix_fallocate returns success. */
@@ -871,6 +932,7 @@ out:
 int UvFsProbeCapabilities(const char *dir,
 			  size_t *direct,
 			  bool *async,
+			  bool *uring,
 			  bool *fallocate,
 			  char *errmsg)
 {
@@ -883,7 +945,7 @@ int UvFsProbeCapabilities(const char *dir,
 	/* Create a temporary probe file. */
 	UvFsRemoveFile(dir, UV__FS_PROBE_FILE, ignored);
 	rv = UvFsAllocateFile(dir, UV__FS_PROBE_FILE, UV__FS_PROBE_FILE_SIZE,
-			      &fd, *fallocate, errmsg);
+			      &fd, *fallocate, true, errmsg);
 	if (rv != 0) {
 		ErrMsgWrapf(errmsg, "create I/O capabilities probe file");
 		goto err;
@@ -901,15 +963,22 @@ int UvFsProbeCapabilities(const char *dir,
 	 * I/O, because io_submit might potentially block. */
 	if (*direct == 0) {
 		*async = false;
-		goto out;
+	} else {
+		rv = probeAsyncIO(fd, *direct, async, errmsg);
+		if (rv != 0) {
+			ErrMsgWrapf(errmsg, "probe Async I/O");
+			goto err_after_file_open;
+		}
 	}
-	rv = probeAsyncIO(fd, *direct, async, errmsg);
-	if (rv != 0) {
-		ErrMsgWrapf(errmsg, "probe Async I/O");
-		goto err_after_file_open;
+
+	/* Without fully asynchronous KAIO, writes would be run in the
+	 * threadpool: use io_uring instead if possible. */
+	*uring = false;
+	if (!*async) {
+		probeIoUring(fd, *direct != 0 ? *direct : UV__FS_PROBE_FILE_SIZE,
+			     uring);
 	}
 
-out:
 	close(fd);
 	return 0;
 
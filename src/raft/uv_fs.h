@@ -36,12 +36,14 @@ int UvFsFileIsEmpty(const char *dir,
 		    char *errmsg);
 
 /* Create the given file in the given directory and allocate the given size to
- * it, returning its file descriptor. The file must not exist yet. */
+ * it, returning its file descriptor. The file must not exist yet. If dsync is
+ * true, the file is opened with O_DSYNC. */
 int UvFsAllocateFile(const char *dir,
 		     const char *filename,
 		     size_t size,
 		     uv_file *fd,
 		     bool fallocate,
+		     bool dsync,
 		     char *errmsg);
 
 /* Create a file and write the given content into it. */
@@ -111,10 +113,15 @@ int UvFsRenameFile(const char *dir,
  * to the block size to use for direct I/O otherwise.
  *
  * The @async parameter will be set to true if fully asynchronous I/O is
- * possible using the KAIO API. */
+ * possible using the KAIO API.
+ *
+ * The @uring parameter will be set to true if fully asynchronous I/O is not
+ * possible using the KAIO API, but writes followed by fdatasync() can be
+ * performed with io_uring. */
 int UvFsProbeCapabilities(const char *dir,
 			  size_t *direct,
 			  bool *async,
+			  bool *uring,
 			  bool *fallocate,
 			  char *errmsg);
 
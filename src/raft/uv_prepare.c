@@ -51,8 +51,11 @@ static void uvPrepareWorkCb(uv_work_t *work)
 	struct uv *uv = segment->uv;
 	int rv;
 
+	/* Writes submitted with io_uring are followed by their own
+	 * fdatasync(). */
 	rv = UvFsAllocateFile(uv->dir, segment->filename, segment->size,
-			      &segment->fd, uv->fallocate, segment->errmsg);
+			      &segment->fd, uv->fallocate, !uv->uring_io,
+			      segment->errmsg);
 	if (rv != 0) {
 		goto err;
 	}
@@ -0,0 +1,319 @@
+#include "uv_uring.h"
+
+#include <errno.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "assert.h"
+#include "syscall.h"
+
+#if HAVE_LINUX_IO_URING_H
+
+#define LOAD_ACQUIRE(P) __atomic_load_n(P, __ATOMIC_ACQUIRE)
+#define STORE_RELEASE(P, V) __atomic_store_n(P, V, __ATOMIC_RELEASE)
+
+#define RING_PTR(BASE, OFFSET) ((unsigned *)((char *)(BASE) + (OFFSET)))
+
+int UvUringInit(struct UvUring *r, unsigned entries)
+{
+	struct io_uring_params p;
+	int rv;
+
+	memset(r, 0, sizeof *r);
+	memset(&p, 0, sizeof p);
+
+	r->fd = io_uring_setup(entries, &p);
+	if (r->fd == -1) {
+		rv = -errno;
+		r->fd = -1;
+		return rv;
+	}
+
+	r->sq_entries = p.sq_entries;
+	r->sq_ring_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+	r->cq_ring_size =
+	    p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+	if (p.features & IORING_FEAT_SINGLE_MMAP) {
+		if (r->cq_ring_size > r->sq_ring_size) {
+			r->sq_ring_size = r->cq_ring_size;
+		}
+		r->cq_ring_size = r->sq_ring_size;
+	}
+
+	r->sq_ring = mmap(NULL, r->sq_ring_size, PROT_READ | PROT_WRITE,
+			  MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_SQ_RING);
+	if (r->sq_ring == MAP_FAILED) {
+		rv = -errno;
+		goto err_after_setup;
+	}
+
+	if (p.features & IORING_FEAT_SINGLE_MMAP) {
+		r->cq_ring = r->sq_ring;
+	} else {
+		r->cq_ring =
+		    mmap(NULL, r->cq_ring_size, PROT_READ | PROT_WRITE,
+			 MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_CQ_RING);
+		if (r->cq_ring == MAP_FAILED) {
+			rv = -errno;
+			goto err_after_sq_ring;
+		}
+	}
+
+	r->sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+	r->sqes = mmap(NULL, r->sqes_size, PROT_READ | PROT_WRITE,
+		       MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_SQES);
+	if (r->sqes == MAP_FAILED) {
+		rv = -errno;
+		goto err_after_cq_ring;
+	}
+
+	r->sq_head = RING_PTR(r->sq_ring, p.sq_off.head);
+	r->sq_tail = RING_PTR(r->sq_ring, p.sq_off.tail);
+	r->sq_mask = RING_PTR(r->sq_ring, p.sq_off.ring_mask);
+	r->sq_array = RING_PTR(r->sq_ring, p.sq_off.array);
+	r->cq_head = RING_PTR(r->cq_ring, p.cq_off.head);
+	r->cq_tail = RING_PTR(r->cq_ring, p.cq_off.tail);
+	r->cq_mask = RING_PTR(r->cq_ring, p.cq_off.ring_mask);
+	r->cqes = (char *)r->cq_ring + p.cq_off.cqes;
+	r->tail = *r->sq_tail;
+
+	return 0;
+
+err_after_cq_ring:
+	if (r->cq_ring != r->sq_ring) {
+		munmap(r->cq_ring, r->cq_ring_size);
+	}
+err_after_sq_ring:
+	munmap(r->sq_ring, r->sq_ring_size);
+err_after_setup:
+	close(r->fd);
+	r->fd = -1;
+	return rv;
+}
+
+void UvUringClose(struct UvUring *r)
+{
+	if (r->fd == -1) {
+		return;
+	}
+	munmap(r->sqes, r->sqes_size);
+	if (r->cq_ring != r->sq_ring) {
+		munmap(r->cq_ring, r->cq_ring_size);
+	}
+	munmap(r->sq_ring, r->sq_ring_size);
+	close(r->fd);
+	r->fd = -1;
+}
+
+static int uvUringRegister(struct UvUring *r,
+			   unsigned opcode,
+			   const void *arg,
+			   unsigned n)
+{
+	int rv;
+	do {
+		rv = io_uring_register(r->fd, opcode, arg, n);
+	} while (rv == -1 && errno == EINTR);
+	if (rv == -1) {
+		return -errno;
+	}
+	return 0;
+}
+
+int UvUringRegisterFile(struct UvUring *r, int fd)
+{
+	return uvUringRegister(r, IORING_REGISTER_FILES, &fd, 1);
+}
+
+int UvUringRegisterBuffer(struct UvUring *r, void *base, size_t len)
+{
+	struct iovec iov;
+	iov.iov_base = base;
+	iov.iov_len = len;
+	return uvUringRegister(r, IORING_REGISTER_BUFFERS, &iov, 1);
+}
+
+int UvUringUnregisterBuffer(struct UvUring *r)
+{
+	return uvUringRegister(r, IORING_UNREGISTER_BUFFERS, NULL, 0);
+}
+
+int UvUringRegisterEventfd(struct UvUring *r, int fd)
+{
+	return uvUringRegister(r, IORING_REGISTER_EVENTFD, &fd, 1);
+}
+
+/* Return the next free submission queue entry. */
+static struct io_uring_sqe *uvUringNextSqe(struct UvUring *r)
+{
+	struct io_uring_sqe *sqe;
+	unsigned index = r->tail & *r->sq_mask;
+
+	sqe = (struct io_uring_sqe *)r->sqes + index;
+	memset(sqe, 0, sizeof *sqe);
+	r->sq_array[index] = index;
+	r->tail++;
+
+	return sqe;
+}
+
+int UvUringPrepWriteSync(struct UvUring *r,
+			 const uv_buf_t bufs[],
+			 unsigned n,
+			 bool fixed,
+			 uint64_t offset,
+			 uint64_t write_data,
+			 uint64_t sync_data)
+{
+	struct io_uring_sqe *sqe;
+
+	assert(n > 0);
+	assert(!fixed || n == 1);
+
+	if (r->tail - LOAD_ACQUIRE(r->sq_head) + 2 > r->sq_entries) {
+		return UV_EAGAIN;
+	}
+
+	sqe = uvUringNextSqe(r);
+	if (fixed) {
+		sqe->opcode = IORING_OP_WRITE_FIXED;
+		sqe->addr = (uint64_t)(uintptr_t)bufs[0].base;
+		sqe->len = (uint32_t)bufs[0].len;
+		sqe->buf_index = 0;
+	} else {
+		sqe->opcode = IORING_OP_WRITEV;
+		sqe->addr = (uint64_t)(uintptr_t)bufs;
+		sqe->len = n;
+	}
+	sqe->fd = 0; /* Index of the registered file */
+	sqe->flags = IOSQE_FIXED_FILE | IOSQE_IO_LINK;
+	sqe->off = offset;
+	sqe->user_data = write_data;
+
+	sqe = uvUringNextSqe(r);
+	sqe->opcode = IORING_OP_FSYNC;
+	sqe->fd = 0;
+	sqe->flags = IOSQE_FIXED_FILE;
+	sqe->fsync_flags = IORING_FSYNC_DATASYNC;
+	sqe->user_data = sync_data;
+
+	return 0;
+}
+
+int UvUringSubmit(struct UvUring *r, unsigned wait_nr)
+{
+	unsigned tail = *r->sq_tail;
+	unsigned to_submit = r->tail - tail;
+	unsigned flags = wait_nr > 0 ? IORING_ENTER_GETEVENTS : 0;
+	int rv;
+
+	STORE_RELEASE(r->sq_tail, r->tail);
+	do {
+		rv = io_uring_enter(r->fd, to_submit, wait_nr, flags, NULL);
+	} while (rv == -1 && errno == EINTR);
+	if (rv == -1) {
+		rv = -errno;
+		/* Drop the requests if the kernel didn't pick them up. */
+		if (LOAD_ACQUIRE(r->sq_head) == tail) {
+			STORE_RELEASE(r->sq_tail, tail);
+			r->tail = tail;
+		}
+		return rv;
+	}
+	return 0;
+}
+
+bool UvUringPeek(struct UvUring *r, uint64_t *user_data, int *res)
+{
+	struct io_uring_cqe *cqe;
+	unsigned head = *r->cq_head;
+
+	if (head == LOAD_ACQUIRE(r->cq_tail)) {
+		return false;
+	}
+	cqe = (struct io_uring_cqe *)r->cqes + (head & *r->cq_mask);
+	*user_data = cqe->user_data;
+	*res = cqe->res;
+	STORE_RELEASE(r->cq_head, head + 1);
+
+	return true;
+}
+
+#else
+
+int UvUringInit(struct UvUring *r, unsigned entries)
+{
+	(void)entries;
+	memset(r, 0, sizeof *r);
+	r->fd = -1;
+	return UV_ENOSYS;
+}
+
+void UvUringClose(struct UvUring *r)
+{
+	(void)r;
+}
+
+int UvUringRegisterFile(struct UvUring *r, int fd)
+{
+	(void)r;
+	(void)fd;
+	return UV_ENOSYS;
+}
+
+int UvUringRegisterBuffer(struct UvUring *r, void *base, size_t len)
+{
+	(void)r;
+	(void)base;
+	(void)len;
+	return UV_ENOSYS;
+}
+
+int UvUringUnregisterBuffer(struct UvUring *r)
+{
+	(void)r;
+	return UV_ENOSYS;
+}
+
+int UvUringRegisterEventfd(struct UvUring *r, int fd)
+{
+	(void)r;
+	(void)fd;
+	return UV_ENOSYS;
+}
+
+int UvUringPrepWriteSync(struct UvUring *r,
+			 const uv_buf_t bufs[],
+			 unsigned n,
+			 bool fixed,
+			 uint64_t offset,
+			 uint64_t write_data,
+			 uint64_t sync_data)
+{
+	(void)r;
+	(void)bufs;
+	(void)n;
+	(void)fixed;
+	(void)offset;
+	(void)write_data;
+	(void)sync_data;
+	return UV_ENOSYS;
+}
+
+int UvUringSubmit(struct UvUring *r, unsigned wait_nr)
+{
+	(void)r;
+	(void)wait_nr;
+	return UV_ENOSYS;
+}
+
+bool UvUringPeek(struct UvUring *r, uint64_t *user_data, int *res)
+{
+	(void)r;
+	(void)user_data;
+	(void)res;
+	return false;
+}
+
+#endif /* HAVE_LINUX_IO_URING_H */
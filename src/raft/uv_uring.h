@@ -0,0 +1,77 @@
+/* Minimal io_uring instance, covering what's needed to append to open segments:
+ * a single registered file, an optional registered buffer, and writes linked
+ * to a fdatasync().
+ *
+ * All functions returning an int return 0 on success or a negative UV_E*
+ * error code. If the kernel headers lack io_uring support, UvUringInit()
+ * always fails with UV_ENOSYS. */
+
+#ifndef UV_URING_H_
+#define UV_URING_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <uv.h>
+
+struct UvUring
+{
+	int fd;              /* Ring file descriptor, or -1 */
+	unsigned sq_entries; /* Size of the submission queue */
+	void *sq_ring;       /* Submission queue ring mapping */
+	size_t sq_ring_size; /* Size of the submission queue ring mapping */
+	void *cq_ring;       /* Completion queue ring mapping, may be sq_ring */
+	size_t cq_ring_size; /* Size of the completion queue ring mapping */
+	void *sqes;          /* Submission queue entries mapping */
+	size_t sqes_size;    /* Size of the submission queue entries mapping */
+	unsigned *sq_head;   /* Head of the submission queue (kernel owned) */
+	unsigned *sq_tail;   /* Tail of the submission queue (user owned) */
+	unsigned *sq_mask;   /* Mask for submission queue indexes */
+	unsigned *sq_array;  /* Indirection array for submission queue entries */
+	unsigned *cq_head;   /* Head of the completion queue (user owned) */
+	unsigned *cq_tail;   /* Tail of the completion queue (kernel owned) */
+	unsigned *cq_mask;   /* Mask for completion queue indexes */
+	void *cqes;          /* Completion queue entries */
+	unsigned tail;       /* Local tail, including entries not submitted */
+};
+
+/* Setup a ring able to hold the given number of submission queue entries. */
+int UvUringInit(struct UvUring *r, unsigned entries);
+
+/* Unmap and close the ring. Requests still in flight are canceled. */
+void UvUringClose(struct UvUring *r);
+
+/* Register the given file as the one targeted by all requests. */
+int UvUringRegisterFile(struct UvUring *r, int fd);
+
+/* Register the given buffer, replacing any previously registered one. */
+int UvUringRegisterBuffer(struct UvUring *r, void *base, size_t len);
+
+/* Unregister the registered buffer, if any. */
+int UvUringUnregisterBuffer(struct UvUring *r);
+
+/* Signal the given eventfd whenever a request completes. */
+int UvUringRegisterEventfd(struct UvUring *r, int fd);
+
+/* Queue a write of the given buffers at the given offset of the registered
+ * file, linked to a fdatasync() of the file that runs only if the write
+ * succeeds in full. If fixed is true, bufs must be a single buffer that lies
+ * within the registered one. The completions of the write and of the sync
+ * carry the given user data values. Fail with UV_EAGAIN if the submission
+ * queue has not enough room. */
+int UvUringPrepWriteSync(struct UvUring *r,
+			 const uv_buf_t bufs[],
+			 unsigned n,
+			 bool fixed,
+			 uint64_t offset,
+			 uint64_t write_data,
+			 uint64_t sync_data);
+
+/* Submit all queued requests and wait for at least wait_nr completions. If the
+ * kernel didn't consume any of the queued requests, they are dropped. */
+int UvUringSubmit(struct UvUring *r, unsigned wait_nr);
+
+/* Pop a completion, if any is available. */
+bool UvUringPeek(struct UvUring *r, uint64_t *user_data, int *res);
+
+#endif /* UV_URING_H_ */
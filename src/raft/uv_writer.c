@@ -138,6 +138,65 @@ static void uvWriterAfterWorkCb(uv_work_t *work, int status)
 	uvWriterReqFinish(req);
 }
 
+/* Tag set in the user data of io_uring write completions. The completions of
+ * the linked syncs carry the bare request pointer. */
+#define UV__WRITER_URING_WRITE 1
+
+/* Process the available io_uring completions. Each request gets two of them,
+ * one for the write and one for the linked fdatasync(), which the kernel
+ * cancels if the write fails or is short. */
+static void uvWriterUringReap(struct UvWriter *w)
+{
+	uint64_t data;
+	int res;
+
+	while (UvUringPeek(&w->ring, &data, &res)) {
+		struct UvWriterReq *req;
+
+		assert(w->n_inflight > 0);
+		w->n_inflight--;
+
+		req = (struct UvWriterReq *)(uintptr_t)(
+		    data & ~(uint64_t)UV__WRITER_URING_WRITE);
+		if (data & UV__WRITER_URING_WRITE) {
+			uvWriterReqSetStatus(req, res);
+		} else if (req->status == 0 && res < 0) {
+			ErrMsgPrintf(req->errmsg, "fdatasync failed: %d", res);
+			req->status = RAFT_IOERR;
+		}
+
+		assert(req->n_cqes > 0);
+		req->n_cqes--;
+		if (req->n_cqes == 0) {
+			uvWriterReqFinish(req);
+		}
+	}
+}
+
+/* Wait for all io_uring requests in flight to complete, so the kernel doesn't
+ * access their memory after they get canceled. */
+static void uvWriterUringDrain(struct UvWriter *w)
+{
+	uint64_t data;
+	int res;
+	int rv;
+
+	while (w->n_inflight > 0) {
+		while (UvUringPeek(&w->ring, &data, &res)) {
+			w->n_inflight--;
+		}
+		if (w->n_inflight == 0) {
+			break;
+		}
+		rv = UvUringSubmit(&w->ring, 1);
+		if (rv != 0) {
+			/* UNTESTED: waiting for completions should not
+			 * fail. */
+			break;
+		}
+	}
+}
+
 /* Callback fired when the event fd associated with AIO write requests should be
  * ready for reading (i.e. when a write has completed). */
 static void uvWriterPollCb(uv_poll_t *poller, int status, int events)
@@ -172,6 +231,11 @@ static void uvWriterPollCb(uv_poll_t *poller, int status, int events)
 	/* TODO: this assertion fails in unit tests */
 	/* assert(completed == 1); */
 
+	if (w->uring) {
+		uvWriterUringReap(w);
+		return;
+	}
+
 	/* Try to fetch the write responses.
 	 *
 	 * If we got here at least one write should have completed and io_events
@@ -229,11 +293,44 @@ fail_requests:
 	}
 }
 
+/* Setup the io_uring instance, with room for a write and a sync for each
+ * concurrent request, and register the file. */
+static int uvWriterUringSetup(struct UvWriter *w, char *errmsg)
+{
+	int rv;
+
+	rv = UvUringInit(&w->ring, 2 * w->n_events);
+	if (rv != 0) {
+		UvOsErrMsg(errmsg, "io_uring_setup", rv);
+		return RAFT_IOERR;
+	}
+
+	rv = UvUringRegisterFile(&w->ring, w->fd);
+	if (rv != 0) {
+		UvOsErrMsg(errmsg, "io_uring_register", rv);
+		UvUringClose(&w->ring);
+		return RAFT_IOERR;
+	}
+
+	return 0;
+}
+
+/* Release the KAIO context or the io_uring instance. */
+static void uvWriterIoTeardown(struct UvWriter *w)
+{
+	if (w->uring) {
+		UvUringClose(&w->ring);
+	} else {
+		UvOsIoDestroy(w->ctx);
+	}
+}
+
 int UvWriterInit(struct UvWriter *w,
 		 struct uv_loop_s *loop,
 		 uv_file fd,
 		 bool direct /* Whether to use direct I/O */,
 		 bool async /* Whether async I/O is available */,
+		 bool uring /* Whether to use io_uring */,
 		 unsigned max_concurrent_writes,
 		 char *errmsg)
 {
@@ -244,9 +341,15 @@ int UvWriterInit(struct UvWriter *w,
 	w->loop = loop;
 	w->fd = fd;
 	w->async = async;
+	w->uring = uring;
 	w->ctx = 0;
 	w->events = NULL;
 	w->n_events = max_concurrent_writes;
+	w->ring.fd = -1;
+	w->n_inflight = 0;
+	w->fixed = true;
+	w->registered.base = NULL;
+	w->registered.len = 0;
 	w->event_fd = -1;
 	w->event_poller.data = NULL;
 	w->check.data = NULL;
@@ -265,19 +368,26 @@ int UvWriterInit(struct UvWriter *w,
 		}
 	}
 
-	/* Setup the AIO context. */
-	rv = uvWriterIoSetup(w->n_events, &w->ctx, errmsg);
-	if (rv != 0) {
-		goto err;
-	}
+	if (w->uring) {
+		rv = uvWriterUringSetup(w, errmsg);
+		if (rv != 0) {
+			goto err;
+		}
+	} else {
+		/* Setup the AIO context. */
+		rv = uvWriterIoSetup(w->n_events, &w->ctx, errmsg);
+		if (rv != 0) {
+			goto err;
+		}
 
-	/* Initialize the array of re-usable event objects. */
-	w->events = RaftHeapCalloc(w->n_events, sizeof *w->events);
-	if (w->events == NULL) {
-		/* UNTESTED: todo */
-		ErrMsgOom(errmsg);
-		rv = RAFT_NOMEM;
-		goto err_after_io_setup;
+		/* Initialize the array of re-usable event objects. */
+		w->events = RaftHeapCalloc(w->n_events, sizeof *w->events);
+		if (w->events == NULL) {
+			/* UNTESTED: todo */
+			ErrMsgOom(errmsg);
+			rv = RAFT_NOMEM;
+			goto err_after_io_setup;
+		}
 	}
 
 	/* Create an event file descriptor to get notified when a write has
@@ -291,6 +401,15 @@ int UvWriterInit(struct UvWriter *w,
 	}
 	w->event_fd = rv;
 
+	if (w->uring) {
+		rv = UvUringRegisterEventfd(&w->ring, w->event_fd);
+		if (rv != 0) {
+			UvOsErrMsg(errmsg, "io_uring_register", rv);
+			rv = RAFT_IOERR;
+			goto err_after_event_fd;
+		}
+	}
+
 	rv = uv_poll_init(loop, &w->event_poller, w->event_fd);
 	if (rv != 0) {
 		/* UNTESTED: with the current libuv implementation this should
@@ -327,7 +446,7 @@ err_after_event_fd:
 err_after_events_alloc:
 	RaftHeapFree(w->events);
 err_after_io_setup:
-	UvOsIoDestroy(w->ctx);
+	uvWriterIoTeardown(w);
 err:
 	assert(rv != 0);
 	return rv;
@@ -339,7 +458,7 @@ static void uvWriterCleanUpAndFireCloseCb(struct UvWriter *w)
 
 	UvOsClose(w->fd);
 	RaftHeapFree(w->events);
-	UvOsIoDestroy(w->ctx);
+	uvWriterIoTeardown(w);
 
 	if (w->close_cb != NULL) {
 		w->close_cb(w);
@@ -351,6 +470,10 @@ static void uvWriterPollerCloseCb(struct uv_handle_s *handle)
 	struct UvWriter *w = handle->data;
 	w->event_poller.data = NULL;
 
+	if (w->uring) {
+		uvWriterUringDrain(w);
+	}
+
 	/* Cancel all pending requests. */
 	while (!queue_empty(&w->poll_queue)) {
 		queue *head;
@@ -425,6 +548,79 @@ static size_t lenOfBufs(const uv_buf_t bufs[], unsigned n)
 	return len;
 }
 
+/* Return true if the given buffer can be written with a fixed buffer write,
+ * registering it if needed. Open segments reuse the same buffer for all their
+ * writes, so it only gets registered again when it grows. */
+static bool uvWriterUringFixed(struct UvWriter *w, const uv_buf_t *buf)
+{
+	uintptr_t base = (uintptr_t)w->registered.base;
+	uintptr_t start = (uintptr_t)buf->base;
+	int rv;
+
+	if (!w->fixed) {
+		return false;
+	}
+	if (base != 0 && start >= base &&
+	    start + buf->len <= base + w->registered.len) {
+		return true;
+	}
+
+	/* The registered buffer can be replaced only if no write uses it. */
+	if (!queue_empty(&w->poll_queue)) {
+		return false;
+	}
+	if (base != 0) {
+		UvUringUnregisterBuffer(&w->ring);
+		w->registered.base = NULL;
+		w->registered.len = 0;
+	}
+	rv = UvUringRegisterBuffer(&w->ring, buf->base, buf->len);
+	if (rv != 0) {
+		/* Most likely the locked memory limit was hit, stick to
+		 * vectored writes. */
+		w->fixed = false;
+		return false;
+	}
+	w->registered = *buf;
+
+	return true;
+}
+
+/* Submit a write linked to a fdatasync() of the file. */
+static int uvWriterUringSubmit(struct UvWriter *w,
+			       struct UvWriterReq *req,
+			       const uv_buf_t bufs[],
+			       unsigned n,
+			       size_t offset)
+{
+	uint64_t data = (uint64_t)(uintptr_t)req;
+	bool fixed = n == 1 && uvWriterUringFixed(w, &bufs[0]);
+	int rv;
+
+	rv = UvUringPrepWriteSync(&w->ring, bufs, n, fixed, offset,
+				  data | UV__WRITER_URING_WRITE, data);
+	if (rv != 0) {
+		/* UNTESTED: the ring has room for max_concurrent_writes
+		 * requests. */
+		UvOsErrMsg(w->errmsg, "io_uring", rv);
+		return RAFT_IOERR;
+	}
+	req->n_cqes = 2;
+
+	/* If the submission fails, the kernel did not consume any request and
+	 * they get dropped from the ring. */
+	queue_insert_tail(&w->poll_queue, &req->queue);
+	rv = UvUringSubmit(&w->ring, 0);
+	if (rv != 0) {
+		queue_remove(&req->queue);
+		UvOsErrMsg(w->errmsg, "io_uring_enter", rv);
+		return RAFT_IOERR;
+	}
+	w->n_inflight += 2;
+
+	return 0;
+}
+
 int UvWriterSubmit(struct UvWriter *w,
 		   struct UvWriterReq *req,
 		   const uv_buf_t bufs[],
@@ -446,7 +642,7 @@ int UvWriterSubmit(struct UvWriter *w,
 
 	assert(w->fd >= 0);
 	assert(w->event_fd >= 0);
-	assert(w->ctx != 0);
+	assert(w->uring || w->ctx != 0);
 	assert(req != NULL);
 	assert(bufs != NULL);
 	assert(n > 0);
@@ -459,6 +655,14 @@ int UvWriterSubmit(struct UvWriter *w,
 	memset(&req->iocb, 0, sizeof req->iocb);
 	memset(req->errmsg, 0, sizeof req->errmsg);
 
+	if (w->uring) {
+		rv = uvWriterUringSubmit(w, req, bufs, n, offset);
+		if (rv != 0) {
+			goto err;
+		}
+		goto done;
+	}
+
 	req->iocb.aio_fildes = (uint32_t)w->fd;
 	req->iocb.aio_lio_opcode = IOCB_CMD_PWRITEV;
 	req->iocb.aio_reqprio = 0;
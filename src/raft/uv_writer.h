@@ -8,6 +8,7 @@
 #include "err.h"
 #include "../lib/queue.h"
 #include "uv_os.h"
+#include "uv_uring.h"
 
 /* Perform asynchronous writes to a single file. */
 struct UvWriter;
@@ -22,9 +23,14 @@ struct UvWriter
 	struct uv_loop_s *loop;  /* Event loop */
 	uv_file fd;              /* File handle */
 	bool async;              /* Whether fully async I/O is supported */
+	bool uring;              /* Whether to use io_uring instead of KAIO */
 	aio_context_t ctx;       /* KAIO handle */
 	struct io_event *events; /* Array of KAIO response objects */
 	unsigned n_events;       /* Length of the events array */
+	struct UvUring ring;     /* io_uring instance, if uring is true */
+	unsigned n_inflight;     /* io_uring completions not yet reaped */
+	bool fixed;              /* Whether to try registering buffers */
+	uv_buf_t registered;     /* Currently registered buffer, if any */
 	int event_fd;            /* Poll'ed to check if write is finished */
 	struct uv_poll_s
 	    event_poller;        /* Poll event_fd for completed poll requests */
@@ -36,12 +42,18 @@ struct UvWriter
 	char *errmsg;             /* Description of last error */
 };
 
-/* Initialize a file writer. */
+/* Initialize a file writer.
+ *
+ * If uring is true, writes are submitted with io_uring, each one linked to a
+ * fdatasync() of the file, so the file doesn't need to be opened with O_DSYNC.
+ * Otherwise they are submitted with KAIO, either directly if async is true or
+ * from the threadpool. */
 int UvWriterInit(struct UvWriter *w,
 		 struct uv_loop_s *loop,
 		 uv_file fd,
 		 bool direct /* Whether to use direct I/O */,
 		 bool async /* Whether async I/O is available */,
+		 bool uring /* Whether to use io_uring */,
 		 unsigned max_concurrent_writes,
 		 char *errmsg);
 
@@ -63,6 +75,7 @@ struct UvWriterReq
 	struct uv_work_s work;   /* To execute logic in the threadpool */
 	UvWriterReqCb cb; /* Callback to invoke upon request completion */
 	struct iocb iocb; /* KAIO request (for writing) */
+	unsigned n_cqes;  /* io_uring completions still expected */
 	char errmsg[256]; /* Error description (for thread-safety) */
 	queue queue;      /* Prev/next links in the inflight queue */
 };
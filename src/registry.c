@@ -10,6 +10,7 @@ void registry__init(struct registry *r, struct config *config)
 {
 	r->config = config;
 	queue_init(&r->dbs);
+	dqlite__metrics_init(&r->metrics);
 }
 
 void registry__close(struct registry *r)
@@ -25,21 +26,31 @@ void registry__close(struct registry *r)
 	}
 }
 
-int registry__db_get(struct registry *r, const char *filename, struct db **db)
+struct db *registry__db_lookup(struct registry *r, const char *filename)
 {
 	queue *head;
 	QUEUE_FOREACH(head, &r->dbs)
 	{
-		*db = QUEUE_DATA(head, struct db, queue);
-		if (strcmp((*db)->filename, filename) == 0) {
-			return 0;
+		struct db *db = QUEUE_DATA(head, struct db, queue);
+		if (strcmp(db->filename, filename) == 0) {
+			return db;
 		}
 	}
+	return NULL;
+}
+
+int registry__db_get(struct registry *r, const char *filename, struct db **db)
+{
+	*db = registry__db_lookup(r, filename);
+	if (*db != NULL) {
+		return 0;
+	}
 	*db = sqlite3_malloc(sizeof **db);
 	if (*db == NULL) {
 		return DQLITE_NOMEM;
 	}
 	db__init(*db, r->config, filename);
+	(*db)->metrics = &r->metrics;
 	queue_insert_tail(&r->dbs, &(*db)->queue);
 	return 0;
 }
@@ -8,16 +8,23 @@
 #include "lib/queue.h"
 
 #include "db.h"
+#include "metrics.h"
 
 struct registry
 {
 	struct config *config;
 	queue dbs;
+	struct dqlite__metrics metrics;
 };
 
 void registry__init(struct registry *r, struct config *config);
 void registry__close(struct registry *r);
 
+/**
+ * Return the db with the given filename, or NULL if no one is registered.
+ */
+struct db *registry__db_lookup(struct registry *r, const char *filename);
+
 /**
  * Get the db with the given filename. If no one is registered, create one.
  */
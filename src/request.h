@@ -42,6 +42,7 @@
 #define REQUEST_TRANSFER(X, ...) X(uint64, id, ##__VA_ARGS__)
 #define REQUEST_DESCRIBE(X, ...) X(uint64, format, ##__VA_ARGS__)
 #define REQUEST_WEIGHT(X, ...) X(uint64, weight, ##__VA_ARGS__)
+#define REQUEST_METRICS(X, ...) X(uint64, format, ##__VA_ARGS__)
 
 #define REQUEST__DEFINE(LOWER, UPPER, _) \
 	SERIALIZE__DEFINE(request_##LOWER, REQUEST_##UPPER);
@@ -64,7 +65,8 @@
 	X(cluster, CLUSTER, __VA_ARGS__)                     \
 	X(transfer, TRANSFER, __VA_ARGS__)                   \
 	X(describe, DESCRIBE, __VA_ARGS__)                   \
-	X(weight, WEIGHT, __VA_ARGS__)
+	X(weight, WEIGHT, __VA_ARGS__)                       \
+	X(metrics, METRICS, __VA_ARGS__)
 
 REQUEST__TYPES(REQUEST__DEFINE);
 
@@ -33,6 +33,7 @@
 #define RESPONSE_ROWS(X, ...) X(uint64, eof, ##__VA_ARGS__)
 #define RESPONSE_EMPTY(X, ...) X(uint64, __unused__, ##__VA_ARGS__)
 #define RESPONSE_FILES(X, ...) X(uint64, n, ##__VA_ARGS__)
+#define RESPONSE_METRICS(X, ...) X(uint64, n, ##__VA_ARGS__)
 #define RESPONSE_SERVERS(X, ...) X(uint64, n, ##__VA_ARGS__)
 #define RESPONSE_METADATA(X, ...)                \
 	X(uint64, failure_domain, ##__VA_ARGS__) \
@@ -54,7 +55,8 @@
 	X(empty, EMPTY, __VA_ARGS__)                       \
 	X(files, FILES, __VA_ARGS__)                       \
 	X(servers, SERVERS, __VA_ARGS__)                   \
-	X(metadata, METADATA, __VA_ARGS__)
+	X(metadata, METADATA, __VA_ARGS__)                 \
+	X(metrics, METRICS, __VA_ARGS__)
 
 RESPONSE__TYPES(RESPONSE__DEFINE);
 
@@ -83,6 +83,7 @@ int dqlite__init(struct dqlite_node *d,
 	if (rv != 0) {
 		goto err_after_config_init;
 	}
+	VfsSetFramePoolCap(&d->vfs, d->config.frame_pool_cap);
 	registry__init(&d->registry, &d->config);
 
 	rv = uv_loop_init(&d->loop);
@@ -127,6 +128,7 @@ int dqlite__init(struct dqlite_node *d,
 		rv = DQLITE_ERROR;
 		goto err;
 	}
+	fsm__set_raft(&d->raft_fsm, &d->raft);
 	/* TODO: expose these values through some API */
 	raft_set_election_timeout(&d->raft, 3000);
 	raft_set_heartbeat_timeout(&d->raft, 500);
@@ -462,6 +464,7 @@ int dqlite_node_enable_disk_mode(dqlite_node *n)
 	if (rv != 0) {
 		return rv;
 	}
+	fsm__set_raft(&n->raft_fsm, &n->raft);
 
 	return 0;
 }
@@ -552,11 +555,30 @@ static void stopCb(uv_async_t *stop)
 	struct conn *conn;
 	int rv;
 
+	bool busy = false;
+
 	/* Nothing to do. */
 	if (!d->running) {
 		tracef("not running or already stopped");
 		return;
 	}
+
+	/* Don't start new background checkpoints, and let the pool retire the
+	 * ones in flight before closing it. */
+	fsm__set_raft(&d->raft_fsm, NULL);
+	QUEUE_FOREACH(head, &d->registry.dbs)
+	{
+		struct db *db = QUEUE_DATA(head, struct db, queue);
+		if (db->checkpoint.state != DB_CHECKPOINT_IDLE) {
+			fsm__checkpoint_flush(db);
+			busy = true;
+		}
+	}
+	if (busy) {
+		tracef("wait for background checkpoints");
+		uv_async_send(stop);
+		return;
+	}
 #ifdef DQLITE_NEXT
 	pool_close(&d->pool);
 #endif
@@ -572,6 +594,13 @@ static void stopCb(uv_async_t *stop)
 		conn = QUEUE_DATA(head, struct conn, queue);
 		conn__stop(conn);
 	}
+
+	/* The raft log can't be closed while the VFS still references the
+	 * payload of some of its entries. */
+	rv = VfsReleaseBorrowed(&d->vfs);
+	if (rv != 0) {
+		tracef("release borrowed pages failed %d", rv);
+	}
 	raft_close(&d->raft, raftCloseCb);
 }
 
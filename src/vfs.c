@@ -16,6 +16,7 @@
 #include "lib/assert.h"
 #include "lib/byte.h"
 
+#include "checksum.h"
 #include "format.h"
 #include "raft.h"
 #include "tracing.h"
@@ -80,11 +81,54 @@ struct vfsShm
 	unsigned exclusive[SQLITE_SHM_NLOCK]; /* Count of exclusive locks */
 };
 
+/* Size of the largest extent a page arena will allocate. Extents start small
+ * and double in size until they reach this cap. */
+#define VFS__ARENA_EXTENT_SIZE (2 * 1024 * 1024)
+
+/* Number of pages held by the first extent of a page arena. */
+#define VFS__ARENA_EXTENT_MIN_PAGES 8
+
+/* Default maximum number of released WAL frames kept for reuse by each
+ * database. */
+#define VFS__FRAME_POOL_CAP 256
+
+/* Initial capacity of the frames and transaction arrays of a WAL. */
+#define VFS__FRAMES_MIN_CAP 16
+
+/* Allocator for page-sized buffers of a single database.
+ *
+ * Pages are carved out of large extents instead of being allocated one at a
+ * time, and released pages are kept in a free list and handed out again. The
+ * free list is intrusive: the first bytes of a released page hold a pointer to
+ * the next released page. All extents are returned to the system when the last
+ * live page is released. */
+struct vfsArena
+{
+	unsigned page_size; /* Size of each page, 0 if not yet known. */
+	void **extents;     /* Allocated extents. */
+	unsigned n_extents; /* Number of allocated extents. */
+	unsigned extent_n;  /* Number of pages in the last extent. */
+	unsigned extent_i;  /* Next never used page in the last extent. */
+	void *free;         /* Head of the list of released pages. */
+	unsigned n_live;    /* Number of pages currently handed out. */
+	size_t resident;    /* Total size of all extents, in bytes. */
+};
+
 /* Hold the content of a single WAL frame. */
 struct vfsFrame
 {
 	uint8_t header[VFS__FRAME_HEADER_SIZE];
 	uint8_t *page; /* Content of the page. */
+	bool borrowed; /* The page is owned by a loan, not by the arena. */
+};
+
+/* Memory lent to the WAL by VfsApplyBorrowed(), along with the frame objects
+ * referencing it. */
+struct vfsLoan
+{
+	vfs_release_cb release_cb; /* Hand the memory back to the lender. */
+	void *arg;                 /* Argument for release_cb. */
+	struct vfsFrame *frames;   /* Borrowed frames, allocated as a block. */
 };
 
 /* WAL-specific content.
@@ -95,66 +139,172 @@ struct vfsWal
 	uint8_t hdr[VFS__WAL_HEADER_SIZE]; /* Header. */
 	struct vfsFrame **frames;          /* All frames committed. */
 	unsigned n_frames;                 /* Number of committed frames. */
+	unsigned cap_frames;               /* Capacity of the frames array. */
 	struct vfsFrame **tx;              /* Frames added by a transaction. */
 	unsigned n_tx;                     /* Number of added frames. */
+	unsigned cap_tx;                   /* Capacity of the tx array. */
+	struct vfsArena *arena;            /* Storage for committed frames. */
+	struct vfsFrame **pool;            /* Released frames ready for reuse. */
+	unsigned n_pool;                   /* Number of frames in the pool. */
+	unsigned cap_pool;                 /* Capacity of the pool array. */
+	unsigned max_pool;                 /* Maximum size of the pool. */
+	struct vfsLoan *loans;             /* Memory referenced by frames. */
+	unsigned n_loans;                  /* Number of outstanding loans. */
+	unsigned cap_loans;                /* Capacity of the loans array. */
 };
 
 /* Database-specific content */
 struct vfsDatabase
 {
-	char *name;         /* Database name. */
-	void **pages;       /* All database. */
-	unsigned page_size; /* Only used for on-disk db */
-	unsigned n_pages;   /* Number of pages. */
-	struct vfsShm shm;  /* Shared memory. */
-	struct vfsWal wal;  /* Associated WAL. */
+	char *name;            /* Database name. */
+	void **pages;          /* All database. */
+	unsigned page_size;    /* Only used for on-disk db */
+	unsigned n_pages;      /* Number of pages. */
+	struct vfsShm shm;     /* Shared memory. */
+	struct vfsWal wal;     /* Associated WAL. */
+	struct vfsArena arena; /* Storage for pages and committed frames. */
 };
 
-/*
- * Generate or extend an 8 byte checksum based on the data in array data[] and
- * the initial values of in[0] and in[1] (or initial values of 0 and 0 if
- * in==NULL).
- *
- * The checksum is written back into out[] before returning.
- *
- * n must be a positive multiple of 8. */
-static void vfsChecksum(
-    uint8_t *data, /* Content to be checksummed */
-    unsigned n,    /* Bytes of content in a[].  Must be a multiple of 8. */
-    const uint32_t in[2], /* Initial checksum value input */
-    uint32_t out[2]       /* OUT: Final checksum value output */
-)
+/* Initialize a new page arena. */
+static void vfsArenaInit(struct vfsArena *a)
+{
+	a->page_size = 0;
+	a->extents = NULL;
+	a->n_extents = 0;
+	a->extent_n = 0;
+	a->extent_i = 0;
+	a->free = NULL;
+	a->n_live = 0;
+	a->resident = 0;
+}
+
+/* Release all extents of a page arena. No page must be live. */
+static void vfsArenaClose(struct vfsArena *a)
 {
-	assert((((uintptr_t)data) % sizeof(uint32_t)) == 0);
+	unsigned i;
+	for (i = 0; i < a->n_extents; i++) {
+		sqlite3_free(a->extents[i]);
+	}
+	if (a->extents != NULL) {
+		sqlite3_free(a->extents);
+	}
+}
 
-	uint32_t s1, s2;
-	uint32_t *cur =
-	    (uint32_t *)__builtin_assume_aligned(data, sizeof(uint32_t));
-	uint32_t *end =
-	    (uint32_t *)__builtin_assume_aligned(&data[n], sizeof(uint32_t));
+/* Revert a page arena to its initial state, releasing all its memory. */
+static void vfsArenaReset(struct vfsArena *a)
+{
+	vfsArenaClose(a);
+	vfsArenaInit(a);
+}
 
-	if (in) {
-		s1 = in[0];
-		s2 = in[1];
-	} else {
-		s1 = s2 = 0;
+/* Allocate a new extent, at least as big as the previous one. */
+static int vfsArenaGrow(struct vfsArena *a)
+{
+	void **extents;
+	void *extent;
+	unsigned n;
+
+	n = a->extent_n * 2;
+	if (n == 0) {
+		n = VFS__ARENA_EXTENT_MIN_PAGES;
+	}
+	if ((size_t)n * a->page_size > VFS__ARENA_EXTENT_SIZE) {
+		n = VFS__ARENA_EXTENT_SIZE / a->page_size;
+	}
+	assert(n > 0);
+
+	extents =
+	    sqlite3_realloc64(a->extents, sizeof *extents * (a->n_extents + 1));
+	if (extents == NULL) {
+		return SQLITE_NOMEM;
+	}
+	a->extents = extents;
+
+	extent = sqlite3_malloc64((sqlite3_uint64)n * a->page_size);
+	if (extent == NULL) {
+		return SQLITE_NOMEM;
+	}
+#if defined(MADV_HUGEPAGE)
+	/* Hint that full-size extents may be backed by transparent huge pages.
+	 * The advice is only applied to the page-aligned interior of the
+	 * extent and failures are harmless. */
+	if ((size_t)n * a->page_size == VFS__ARENA_EXTENT_SIZE) {
+		size_t os_page = (size_t)sysconf(_SC_PAGESIZE);
+		uintptr_t start = ((uintptr_t)extent + os_page - 1) &
+				  ~((uintptr_t)os_page - 1);
+		uintptr_t end =
+		    ((uintptr_t)extent + VFS__ARENA_EXTENT_SIZE) &
+		    ~((uintptr_t)os_page - 1);
+		if (end > start) {
+			madvise((void *)start, end - start, MADV_HUGEPAGE);
+		}
+	}
+#endif
+
+	a->extents[a->n_extents] = extent;
+	a->n_extents++;
+	a->extent_n = n;
+	a->extent_i = 0;
+	a->resident += (size_t)n * a->page_size;
+
+	return SQLITE_OK;
+}
+
+/* Get a page of the given size from the arena, or NULL if out of memory. The
+ * content of the returned page is undefined. */
+static void *vfsArenaGet(struct vfsArena *a, unsigned page_size)
+{
+	void *page;
+
+	assert(page_size > 0);
+
+	if (a->page_size != page_size) {
+		/* The page size can change only when no page is live. */
+		assert(a->n_live == 0);
+		vfsArenaReset(a);
+		a->page_size = page_size;
 	}
 
-	assert(n >= 8);
-	assert((n & 0x00000007) == 0);
-	assert(n <= 65536);
+	if (a->free != NULL) {
+		page = a->free;
+		memcpy(&a->free, page, sizeof a->free);
+		a->n_live++;
+		return page;
+	}
+
+	if (a->extent_i == a->extent_n) {
+		if (vfsArenaGrow(a) != SQLITE_OK) {
+			return NULL;
+		}
+	}
 
-	do {
-		s1 += *cur++ + s2;
-		s2 += *cur++ + s1;
-	} while (cur < end);
+	page = (uint8_t *)a->extents[a->n_extents - 1] +
+	       (size_t)a->extent_i * a->page_size;
+	a->extent_i++;
+	a->n_live++;
+
+	return page;
+}
+
+/* Return a page to the arena. */
+static void vfsArenaPut(struct vfsArena *a, void *page)
+{
+	assert(page != NULL);
+	assert(a->n_live > 0);
+
+	a->n_live--;
+	if (a->n_live == 0) {
+		vfsArenaReset(a);
+		return;
+	}
 
-	out[0] = s1;
-	out[1] = s2;
+	memcpy(page, &a->free, sizeof a->free);
+	a->free = page;
 }
 
-/* Create a new frame of a WAL file. */
-static struct vfsFrame *vfsFrameCreate(unsigned size)
+/* Create a new WAL frame, whose page is allocated from the given arena. */
+static struct vfsFrame *vfsFrameCreateFromArena(struct vfsArena *a,
+						unsigned size)
 {
 	struct vfsFrame *f;
 
@@ -162,35 +312,58 @@ static struct vfsFrame *vfsFrameCreate(unsigned size)
 
 	f = sqlite3_malloc(sizeof *f);
 	if (f == NULL) {
-		goto oom;
+		return NULL;
 	}
 
-	f->page = sqlite3_malloc64(size);
+	f->page = vfsArenaGet(a, size);
 	if (f->page == NULL) {
-		goto oom_after_page_alloc;
+		sqlite3_free(f);
+		return NULL;
 	}
-
-	memset(f->header, 0, FORMAT__WAL_FRAME_HDR_SIZE);
-	memset(f->page, 0, (size_t)size);
+	f->borrowed = false;
 
 	return f;
-
-oom_after_page_alloc:
-	sqlite3_free(f);
-oom:
-	return NULL;
 }
 
-/* Destroy a WAL frame */
-static void vfsFrameDestroy(struct vfsFrame *f)
+/* Destroy a WAL frame, returning its page to the given arena. */
+static void vfsFrameDestroyToArena(struct vfsArena *a, struct vfsFrame *f)
 {
 	assert(f != NULL);
 	assert(f->page != NULL);
+	assert(!f->borrowed);
 
-	sqlite3_free(f->page);
+	vfsArenaPut(a, f->page);
 	sqlite3_free(f);
 }
 
+/* Make sure that the given array of frame pointers has room for at least n
+ * items, growing its capacity geometrically. */
+static int vfsFramesReserve(struct vfsFrame ***frames,
+			    unsigned *cap,
+			    unsigned n)
+{
+	struct vfsFrame **array;
+	unsigned new_cap;
+
+	if (n <= *cap) {
+		return SQLITE_OK;
+	}
+
+	new_cap = *cap > 0 ? *cap : VFS__FRAMES_MIN_CAP;
+	while (new_cap < n) {
+		new_cap *= 2;
+	}
+
+	array = sqlite3_realloc64(*frames, sizeof *array * new_cap);
+	if (array == NULL) {
+		return SQLITE_NOMEM;
+	}
+	*frames = array;
+	*cap = new_cap;
+
+	return SQLITE_OK;
+}
+
 /* Initialize the shared memory mapping of a database file. */
 static void vfsShmInit(struct vfsShm *s)
 {
@@ -234,14 +407,94 @@ static void vfsShmReset(struct vfsShm *s)
 	vfsShmInit(s);
 }
 
-/* Initialize a new WAL object. */
-static void vfsWalInit(struct vfsWal *w)
+/* Initialize a new WAL object. Committed frames will be allocated from the
+ * given arena. */
+static void vfsWalInit(struct vfsWal *w, struct vfsArena *arena)
 {
 	memset(w->hdr, 0, VFS__WAL_HEADER_SIZE);
 	w->frames = NULL;
 	w->n_frames = 0;
+	w->cap_frames = 0;
 	w->tx = NULL;
 	w->n_tx = 0;
+	w->cap_tx = 0;
+	w->arena = arena;
+	w->pool = NULL;
+	w->n_pool = 0;
+	w->cap_pool = 0;
+	w->max_pool = VFS__FRAME_POOL_CAP;
+	w->loans = NULL;
+	w->n_loans = 0;
+	w->cap_loans = 0;
+}
+
+/* Get a frame from the pool of released frames of the WAL, or create a new one
+ * if the pool is empty. */
+static struct vfsFrame *vfsWalFrameAlloc(struct vfsWal *w, unsigned page_size)
+{
+	if (w->n_pool > 0) {
+		w->n_pool--;
+		return w->pool[w->n_pool];
+	}
+	return vfsFrameCreateFromArena(w->arena, page_size);
+}
+
+/* Release a frame, keeping it in the pool for later reuse unless the pool is
+ * full. */
+static void vfsWalFrameRelease(struct vfsWal *w, struct vfsFrame *f)
+{
+	if (w->n_pool < w->max_pool &&
+	    vfsFramesReserve(&w->pool, &w->cap_pool, w->n_pool + 1) ==
+		SQLITE_OK) {
+		w->pool[w->n_pool] = f;
+		w->n_pool++;
+		return;
+	}
+	vfsFrameDestroyToArena(w->arena, f);
+}
+
+/* Shrink the pool of released frames to at most the given size, giving the
+ * memory of the excess frames back to the arena. */
+static void vfsWalPoolTrim(struct vfsWal *w, unsigned n)
+{
+	while (w->n_pool > n) {
+		w->n_pool--;
+		vfsFrameDestroyToArena(w->arena, w->pool[w->n_pool]);
+	}
+	if (w->n_pool == 0 && w->pool != NULL) {
+		sqlite3_free(w->pool);
+		w->pool = NULL;
+		w->cap_pool = 0;
+	}
+}
+
+/* Discard the frames of the current transaction, releasing them to the
+ * pool. */
+static void vfsWalDropTx(struct vfsWal *w)
+{
+	unsigned i;
+	for (i = 0; i < w->n_tx; i++) {
+		vfsWalFrameRelease(w, w->tx[i]);
+	}
+	w->n_tx = 0;
+}
+
+/* Hand back all the memory lent to the WAL. The frames referencing it must
+ * have been dropped already. */
+static void vfsWalReleaseLoans(struct vfsWal *w)
+{
+	unsigned i;
+	for (i = 0; i < w->n_loans; i++) {
+		struct vfsLoan *loan = &w->loans[i];
+		sqlite3_free(loan->frames);
+		loan->release_cb(loan->arg);
+	}
+	w->n_loans = 0;
+	if (w->loans != NULL) {
+		sqlite3_free(w->loans);
+		w->loans = NULL;
+		w->cap_loans = 0;
+	}
 }
 
 /* Initialize a new database object. */
@@ -250,22 +503,27 @@ static void vfsDatabaseInit(struct vfsDatabase *d)
 	d->pages = NULL;
 	d->n_pages = 0;
 	d->page_size = 0;
+	vfsArenaInit(&d->arena);
 	vfsShmInit(&d->shm);
-	vfsWalInit(&d->wal);
+	vfsWalInit(&d->wal, &d->arena);
 }
 
 /* Release all memory used by a WAL object. */
 static void vfsWalClose(struct vfsWal *w)
 {
 	unsigned i;
+	vfsWalPoolTrim(w, 0);
 	for (i = 0; i < w->n_frames; i++) {
-		vfsFrameDestroy(w->frames[i]);
+		if (!w->frames[i]->borrowed) {
+			vfsFrameDestroyToArena(w->arena, w->frames[i]);
+		}
 	}
 	if (w->frames != NULL) {
 		sqlite3_free(w->frames);
 	}
+	vfsWalReleaseLoans(w);
 	for (i = 0; i < w->n_tx; i++) {
-		vfsFrameDestroy(w->tx[i]);
+		vfsFrameDestroyToArena(w->arena, w->tx[i]);
 	}
 	if (w->tx != NULL) {
 		sqlite3_free(w->tx);
@@ -275,15 +533,13 @@ static void vfsWalClose(struct vfsWal *w)
 /* Release all memory used by a database object. */
 static void vfsDatabaseClose(struct vfsDatabase *d)
 {
-	unsigned i;
-	for (i = 0; d->pages != NULL && i < d->n_pages; i++) {
-		sqlite3_free(d->pages[i]);
-	}
+	/* Pages are owned by the arena, which is released below. */
 	if (d->pages != NULL) {
 		sqlite3_free(d->pages);
 	}
 	vfsShmClose(&d->shm);
 	vfsWalClose(&d->wal);
+	vfsArenaClose(&d->arena);
 }
 
 /* Destroy the content of a database object. */
@@ -353,7 +609,7 @@ static int vfsDatabaseGetPage(struct vfsDatabase *d,
 
 	/* Create a new page, grow the page array, and append the
 	 * new page to it. */
-	*page = sqlite3_malloc64(page_size);
+	*page = vfsArenaGet(&d->arena, page_size);
 	if (*page == NULL) {
 		rc = SQLITE_NOMEM;
 		goto err;
@@ -369,7 +625,7 @@ static int vfsDatabaseGetPage(struct vfsDatabase *d,
 
 	/* Allocate a page to store the pending_byte */
 	if (pending_byte_page_reached) {
-		void *pending_byte_page = sqlite3_malloc64(page_size);
+		void *pending_byte_page = vfsArenaGet(&d->arena, page_size);
 		if (pending_byte_page == NULL) {
 			rc = SQLITE_NOMEM;
 			goto err_after_pending_byte_page;
@@ -387,7 +643,7 @@ err_after_pending_byte_page:
 	d->pages = pages;
 
 err_after_vfs_page_create:
-	sqlite3_free(*page);
+	vfsArenaPut(&d->arena, *page);
 err:
 	*page = NULL;
 	return rc;
@@ -414,8 +670,6 @@ static int vfsWalFrameGet(struct vfsWal *w,
 	if (index == w->n_frames + w->n_tx + 1) {
 		/* Create a new frame, grow the transaction array, and append
 		 * the new frame to it. */
-		struct vfsFrame **tx;
-
 		/* We assume that the page size has been set, either by
 		 * intervepting the first main database file write, or by
 		 * handling a 'PRAGMA page_size=N' command in
@@ -423,23 +677,20 @@ static int vfsWalFrameGet(struct vfsWal *w,
 		 * vfsFileWrite(). */
 		assert(page_size > 0);
 
-		*frame = vfsFrameCreate(page_size);
+		*frame = vfsWalFrameAlloc(w, page_size);
 		if (*frame == NULL) {
 			rv = SQLITE_NOMEM;
 			goto err;
 		}
+		memset((*frame)->header, 0, FORMAT__WAL_FRAME_HDR_SIZE);
 
-		tx = sqlite3_realloc64(w->tx, sizeof *tx * w->n_tx + 1);
-		if (tx == NULL) {
-			rv = SQLITE_NOMEM;
+		rv = vfsFramesReserve(&w->tx, &w->cap_tx, w->n_tx + 1);
+		if (rv != SQLITE_OK) {
 			goto err_after_vfs_frame_create;
 		}
 
-		/* Append the new page to the new page array. */
-		tx[index - w->n_frames - 1] = *frame;
-
-		/* Update the page array. */
-		w->tx = tx;
+		/* Append the new page to the page array. */
+		w->tx[index - w->n_frames - 1] = *frame;
 		w->n_tx++;
 	} else {
 		/* Return the existing page. */
@@ -450,7 +701,7 @@ static int vfsWalFrameGet(struct vfsWal *w,
 	return SQLITE_OK;
 
 err_after_vfs_frame_create:
-	vfsFrameDestroy(*frame);
+	vfsWalFrameRelease(w, *frame);
 err:
 	*frame = NULL;
 	return rv;
@@ -572,7 +823,7 @@ static int vfsDatabaseTruncate(struct vfsDatabase *d, sqlite_int64 size)
 	/* Destroy pages beyond pages_len. */
 	cursor = d->pages + n_pages;
 	for (i = 0; i < (d->n_pages - n_pages); i++) {
-		sqlite3_free(*cursor);
+		vfsArenaPut(&d->arena, *cursor);
 		cursor++;
 	}
 
@@ -588,10 +839,34 @@ static int vfsDatabaseTruncate(struct vfsDatabase *d, sqlite_int64 size)
 }
 
 /* Truncate a WAL file to zero. */
-static int vfsWalTruncate(struct vfsWal *w, sqlite3_int64 size)
+/* Drop all committed frames, which must have been checkpointed. */
+static void vfsWalReset(struct vfsWal *w)
 {
 	unsigned i;
 
+	assert(w->frames != NULL);
+
+	/* Release all frames, keeping some of them around for reuse by the
+	 * next transactions, and hand back borrowed pages. */
+	for (i = 0; i < w->n_frames; i++) {
+		if (!w->frames[i]->borrowed) {
+			vfsWalFrameRelease(w, w->frames[i]);
+		}
+	}
+	w->n_frames = 0;
+	vfsWalReleaseLoans(w);
+
+	/* Don't hold on to a frames array much bigger than what the pool will
+	 * help refill. */
+	if (w->cap_frames > w->max_pool) {
+		sqlite3_free(w->frames);
+		w->frames = NULL;
+		w->cap_frames = 0;
+	}
+}
+
+static int vfsWalTruncate(struct vfsWal *w, sqlite3_int64 size)
+{
 	/* We expect SQLite to only truncate to zero, after a
 	 * full checkpoint.
 	 *
@@ -606,19 +881,10 @@ static int vfsWalTruncate(struct vfsWal *w, sqlite3_int64 size)
 		return SQLITE_OK;
 	}
 
-	assert(w->frames != NULL);
-
 	/* Restart the header. */
 	formatWalRestartHeader(w->hdr);
 
-	/* Destroy all frames. */
-	for (i = 0; i < w->n_frames; i++) {
-		vfsFrameDestroy(w->frames[i]);
-	}
-	sqlite3_free(w->frames);
-
-	w->frames = NULL;
-	w->n_frames = 0;
+	vfsWalReset(w);
 
 	return SQLITE_OK;
 }
@@ -649,6 +915,7 @@ struct vfs
 	int error;                      /* Last error occurred. */
 	bool disk; /* True if the database is kept on disk. */
 	struct sqlite3_vfs *base_vfs; /* Base VFS. */
+	unsigned frame_pool_cap; /* Max released WAL frames kept per database */
 };
 
 /* Create a new vfs object. */
@@ -665,6 +932,7 @@ static struct vfs *vfsCreate(void)
 	v->n_databases = 0;
 	v->error = 0;
 	v->disk = false;
+	v->frame_pool_cap = VFS__FRAME_POOL_CAP;
 	v->base_vfs = sqlite3_vfs_find("unix");
 	assert(v->base_vfs != NULL);
 
@@ -1032,6 +1300,14 @@ static int vfsWalWrite(struct vfsWal *w,
 		 * bytes. */
 		assert(amount == VFS__WAL_HEADER_SIZE);
 
+		/* A writer rewrites the header of a non-empty WAL only when
+		 * restarting it after all its frames were copied back by a
+		 * passive checkpoint, and no reader uses them anymore. */
+		if (w->n_frames > 0) {
+			assert(w->n_tx == 0);
+			vfsWalReset(w);
+		}
+
 		memcpy(w->hdr, buf, (size_t)amount);
 		return SQLITE_OK;
 	}
@@ -1313,14 +1589,14 @@ static void vfsFrameFill(struct vfsFrame *f,
 			 uint32_t database_size,
 			 uint32_t salt[2],
 			 uint32_t checksum[2],
-			 uint8_t *page,
+			 const uint8_t *page,
 			 uint32_t page_size)
 {
 	BytePutBe32(page_number, &f->header[0]);
 	BytePutBe32(database_size, &f->header[4]);
 
-	vfsChecksum(f->header, 8, checksum, checksum);
-	vfsChecksum(page, page_size, checksum, checksum);
+	ChecksumWal(true, f->header, 8, checksum);
+	ChecksumWal(true, page, page_size, checksum);
 
 	memcpy(&f->header[8], &salt[0], sizeof salt[0]);
 	memcpy(&f->header[12], &salt[1], sizeof salt[1]);
@@ -1328,7 +1604,9 @@ static void vfsFrameFill(struct vfsFrame *f,
 	BytePutBe32(checksum[0], &f->header[16]);
 	BytePutBe32(checksum[1], &f->header[20]);
 
-	memcpy(f->page, page, page_size);
+	if (f->page != page) {
+		memcpy(f->page, page, page_size);
+	}
 }
 
 /* This function modifies part of the WAL index header to reflect the current
@@ -1386,7 +1664,7 @@ static void vfsAmendWalIndexHeader(struct vfsDatabase *d)
 	*(uint32_t *)(__builtin_assume_aligned(&index[28], sizeof(uint32_t))) =
 	    frame_checksum[1];
 
-	vfsChecksum(index, 40, checksum, checksum);
+	ChecksumWal(true, index, 40, checksum);
 
 	*(uint32_t *)__builtin_assume_aligned(&index[40], sizeof(uint32_t)) =
 	    checksum[0];
@@ -1608,7 +1886,6 @@ static void vfsWalRollbackIfUncommitted(struct vfsWal *w)
 {
 	struct vfsFrame *last;
 	uint32_t commit;
-	unsigned i;
 
 	if (w->n_tx == 0) {
 		return;
@@ -1623,11 +1900,7 @@ static void vfsWalRollbackIfUncommitted(struct vfsWal *w)
 		return;
 	}
 
-	for (i = 0; i < w->n_tx; i++) {
-		vfsFrameDestroy(w->tx[i]);
-	}
-
-	w->n_tx = 0;
+	vfsWalDropTx(w);
 }
 
 static int vfsFileShmLock(sqlite3_file *file, int ofst, int n, int flags)
@@ -1764,6 +2037,7 @@ static struct vfsDatabase *vfsCreateDatabase(struct vfs *v, const char *name)
 	strcpy(d->name, name);
 
 	vfsDatabaseInit(d);
+	d->wal.max_pool = v->frame_pool_cap;
 
 	v->databases[n - 1] = d;
 	v->n_databases = n;
@@ -2098,15 +2372,14 @@ void VfsClose(struct sqlite3_vfs *vfs)
 	sqlite3_free(v);
 }
 
-static int vfsWalPoll(struct vfsWal *w, dqlite_vfs_frame **frames, unsigned *n)
+/* Return the number of frames of the current transaction if it's committed, or
+ * zero if there's no transaction or it's not committed yet. */
+static unsigned vfsWalCommittedTx(struct vfsWal *w)
 {
 	struct vfsFrame *last;
 	uint32_t commit;
-	unsigned i;
 
 	if (w->n_tx == 0) {
-		*frames = NULL;
-		*n = 0;
 		return 0;
 	}
 
@@ -2115,29 +2388,96 @@ static int vfsWalPoll(struct vfsWal *w, dqlite_vfs_frame **frames, unsigned *n)
 	commit = vfsFrameGetDatabaseSize(last);
 
 	if (commit == 0) {
+		return 0;
+	}
+
+	return w->n_tx;
+}
+
+static int vfsWalPoll(struct vfsWal *w, dqlite_vfs_frame **frames, unsigned *n)
+{
+	uint32_t page_size;
+	unsigned i;
+
+	*n = vfsWalCommittedTx(w);
+	if (*n == 0) {
 		*frames = NULL;
-		*n = 0;
 		return 0;
 	}
 
-	*frames = sqlite3_malloc64(sizeof **frames * w->n_tx);
+	page_size = vfsWalGetPageSize(w);
+
+	*frames = sqlite3_malloc64(sizeof **frames * *n);
 	if (*frames == NULL) {
-		return DQLITE_NOMEM;
+		goto oom;
 	}
-	*n = w->n_tx;
 
-	for (i = 0; i < w->n_tx; i++) {
+	/* The pages of the transaction are owned by the WAL, hand copies of
+	 * them to the caller. */
+	for (i = 0; i < *n; i++) {
 		dqlite_vfs_frame *frame = &(*frames)[i];
-		uint32_t page_number = vfsFrameGetPageNumber(w->tx[i]);
-		frame->data = w->tx[i]->page;
-		frame->page_number = page_number;
-		/* Release the vfsFrame object, but not its buf attribute, since
-		 * responsibility for that memory has been transferred to the
-		 * caller. */
-		sqlite3_free(w->tx[i]);
+		frame->data = sqlite3_malloc64(page_size);
+		if (frame->data == NULL) {
+			goto oom_after_frames_alloc;
+		}
+		memcpy(frame->data, w->tx[i]->page, page_size);
+		frame->page_number = vfsFrameGetPageNumber(w->tx[i]);
 	}
 
-	w->n_tx = 0;
+	vfsWalDropTx(w);
+
+	return 0;
+
+oom_after_frames_alloc:
+	while (i > 0) {
+		i--;
+		sqlite3_free((*frames)[i].data);
+	}
+	sqlite3_free(*frames);
+oom:
+	*frames = NULL;
+	*n = 0;
+	return DQLITE_NOMEM;
+}
+
+/* Copy the page numbers and the pages of the current transaction, which must
+ * be committed and have n frames, into the given buffers. */
+static void vfsWalPollInto(struct vfsWal *w,
+			   unsigned n,
+			   void *page_numbers,
+			   void *pages)
+{
+	uint32_t page_size;
+	unsigned i;
+
+	assert(vfsWalCommittedTx(w) == n);
+
+	page_size = vfsWalGetPageSize(w);
+
+	for (i = 0; i < n; i++) {
+		uint64_t page_number =
+		    ByteFlipLe64(vfsFrameGetPageNumber(w->tx[i]));
+		memcpy((uint8_t *)page_numbers + i * sizeof page_number,
+		       &page_number, sizeof page_number);
+		memcpy((uint8_t *)pages + (size_t)i * page_size,
+		       w->tx[i]->page, page_size);
+	}
+
+	vfsWalDropTx(w);
+}
+
+/* Take the write lock and make the frames polled from the WAL invisible to
+ * readers until they get applied. */
+static int vfsDatabaseHoldPolled(struct vfsDatabase *d)
+{
+	int rv;
+
+	rv = vfsShmLock(&d->shm, 0, 1, SQLITE_SHM_EXCLUSIVE);
+	if (rv != 0) {
+		tracef("shm lock failed %d", rv);
+		return rv;
+	}
+	vfsAmendWalIndexHeader(d);
 
 	return 0;
 }
@@ -2150,8 +2490,6 @@ int VfsPoll(sqlite3_vfs *vfs,
 	tracef("vfs poll filename:%s", filename);
 	struct vfs *v;
 	struct vfsDatabase *database;
-	struct vfsShm *shm;
-	struct vfsWal *wal;
 	int rv;
 
 	v = (struct vfs *)(vfs->pAppData);
@@ -2162,16 +2500,7 @@ int VfsPoll(sqlite3_vfs *vfs,
 		return DQLITE_ERROR;
 	}
 
-	shm = &database->shm;
-	wal = &database->wal;
-
-	if (wal == NULL) {
-		*frames = NULL;
-		*n = 0;
-		return 0;
-	}
-
-	rv = vfsWalPoll(wal, frames, n);
+	rv = vfsWalPoll(&database->wal, frames, n);
 	if (rv != 0) {
 		tracef("wal poll failed %d", rv);
 		return rv;
@@ -2179,17 +2508,55 @@ int VfsPoll(sqlite3_vfs *vfs,
 
 	/* If some frames have been written take the write lock. */
 	if (*n > 0) {
-		rv = vfsShmLock(shm, 0, 1, SQLITE_SHM_EXCLUSIVE);
-		if (rv != 0) {
-			tracef("shm lock failed %d", rv);
-			return rv;
-		}
-		vfsAmendWalIndexHeader(database);
+		return vfsDatabaseHoldPolled(database);
+	}
+
+	return 0;
+}
+
+int VfsPollCount(sqlite3_vfs *vfs, const char *filename, unsigned *n)
+{
+	struct vfs *v;
+	struct vfsDatabase *database;
+
+	v = (struct vfs *)(vfs->pAppData);
+	database = vfsDatabaseLookup(v, filename);
+
+	if (database == NULL) {
+		tracef("not found");
+		return DQLITE_ERROR;
 	}
 
+	*n = vfsWalCommittedTx(&database->wal);
+
 	return 0;
 }
 
+int VfsPollInto(sqlite3_vfs *vfs,
+		const char *filename,
+		unsigned n,
+		void *page_numbers,
+		void *pages)
+{
+	tracef("vfs poll into filename:%s n:%u", filename, n);
+	struct vfs *v;
+	struct vfsDatabase *database;
+
+	assert(n > 0);
+
+	v = (struct vfs *)(vfs->pAppData);
+	database = vfsDatabaseLookup(v, filename);
+
+	if (database == NULL) {
+		tracef("not found");
+		return DQLITE_ERROR;
+	}
+
+	vfsWalPollInto(&database->wal, n, page_numbers, pages);
+
+	return vfsDatabaseHoldPolled(database);
+}
+
 /* Return the salt-1 field stored in the WAL header.*/
 static uint32_t vfsWalGetSalt1(struct vfsWal *w)
 {
@@ -2218,12 +2585,19 @@ static uint32_t vfsWalGetChecksum2(struct vfsWal *w)
 	return ByteGetBe32(&w->hdr[28]);
 }
 
-/* Append the given pages as new frames. */
+/* Append the given pages as new frames.
+ *
+ * Page numbers are read from page_numbers if not NULL, otherwise from
+ * le_page_numbers, which holds 64-bit little-endian integers. If loan is not
+ * NULL, the new frames are taken from its block and reference the given pages
+ * instead of copying them. */
 static int vfsWalAppend(struct vfsWal *w,
 			unsigned database_n_pages,
 			unsigned n,
 			unsigned long *page_numbers,
-			uint8_t *pages)
+			const uint8_t *le_page_numbers,
+			uint8_t *pages,
+			struct vfsLoan *loan)
 {
 	struct vfsFrame **frames; /* New frames array. */
 	uint32_t page_size;
@@ -2259,21 +2633,35 @@ static int vfsWalAppend(struct vfsWal *w,
 		database_size = vfsFrameGetDatabaseSize(frame);
 	}
 
-	frames =
-	    sqlite3_realloc64(w->frames, sizeof *frames * (w->n_frames + n));
-	if (frames == NULL) {
+	if (vfsFramesReserve(&w->frames, &w->cap_frames, w->n_frames + n) !=
+	    SQLITE_OK) {
 		goto oom;
 	}
-	w->frames = frames;
+	frames = w->frames;
 
 	for (i = 0; i < n; i++) {
-		struct vfsFrame *frame = vfsFrameCreate(page_size);
-		uint32_t page_number = (uint32_t)page_numbers[i];
+		struct vfsFrame *frame;
+		uint32_t page_number;
 		uint32_t commit = 0;
-		uint8_t *page = &pages[i * page_size];
+		uint8_t *page = &pages[(size_t)i * page_size];
 
-		if (frame == NULL) {
-			goto oom_after_frames_alloc;
+		if (loan != NULL) {
+			frame = &loan->frames[i];
+			frame->page = page;
+			frame->borrowed = true;
+		} else {
+			frame = vfsWalFrameAlloc(w, page_size);
+			if (frame == NULL) {
+				goto oom_after_frames_alloc;
+			}
+		}
+
+		if (page_numbers != NULL) {
+			page_number = (uint32_t)page_numbers[i];
+		} else {
+			uint64_t le;
+			memcpy(&le, le_page_numbers + i * sizeof le, sizeof le);
+			page_number = (uint32_t)ByteFlipLe64(le);
 		}
 
 		if (page_number > database_size) {
@@ -2298,7 +2686,7 @@ static int vfsWalAppend(struct vfsWal *w,
 
 oom_after_frames_alloc:
 	for (j = 0; j < i; j++) {
-		vfsFrameDestroy(frames[w->n_frames + j]);
+		vfsWalFrameRelease(w, frames[w->n_frames + j]);
 	}
 oom:
 	return DQLITE_NOMEM;
@@ -2327,7 +2715,7 @@ static void vfsWalStartHeader(struct vfsWal *w, uint32_t page_size)
 	BytePutBe32(page_size, &w->hdr[8]);
 	BytePutBe32(0, &w->hdr[12]);
 	sqlite3_randomness(8, &w->hdr[16]);
-	vfsChecksum(w->hdr, 24, checksum, checksum);
+	ChecksumWal(true, w->hdr, 24, checksum);
 	BytePutBe32(checksum[0], w->hdr + 24);
 	BytePutBe32(checksum[1], w->hdr + 28);
 }
@@ -2356,27 +2744,19 @@ static void vfsInvalidateWalIndexHeader(struct vfsDatabase *d)
 	header[VFS__WAL_INDEX_HEADER_SIZE] = 0;
 }
 
-int VfsApply(sqlite3_vfs *vfs,
-	     const char *filename,
-	     unsigned n,
-	     unsigned long *page_numbers,
-	     void *frames)
+/* Append the given pages to the WAL of a database and make them visible to
+ * readers. See vfsWalAppend() for the meaning of the arguments. */
+static int vfsDatabaseApply(struct vfsDatabase *database,
+			    unsigned n,
+			    unsigned long *page_numbers,
+			    const uint8_t *le_page_numbers,
+			    uint8_t *pages,
+			    struct vfsLoan *loan)
 {
-	tracef("vfs apply filename %s n %u", filename, n);
-	struct vfs *v;
-	struct vfsDatabase *database;
-	struct vfsWal *wal;
-	struct vfsShm *shm;
+	struct vfsWal *wal = &database->wal;
+	struct vfsShm *shm = &database->shm;
 	int rv;
 
-	v = (struct vfs *)(vfs->pAppData);
-	database = vfsDatabaseLookup(v, filename);
-
-	assert(database != NULL);
-
-	wal = &database->wal;
-	shm = &database->shm;
-
 	/* If there's no page size set in the WAL header, it must mean that WAL
 	 * file was never written. In that case we need to initialize the WAL
 	 * header. */
@@ -2384,7 +2764,8 @@ int VfsApply(sqlite3_vfs *vfs,
 		vfsWalStartHeader(wal, vfsDatabaseGetPageSize(database));
 	}
 
-	rv = vfsWalAppend(wal, database->n_pages, n, page_numbers, frames);
+	rv = vfsWalAppend(wal, database->n_pages, n, page_numbers,
+			  le_page_numbers, pages, loan);
 	if (rv != 0) {
 		tracef("wal append failed rv:%d n_pages:%u n:%u", rv,
 		       database->n_pages, n);
@@ -2412,6 +2793,158 @@ int VfsApply(sqlite3_vfs *vfs,
 	return 0;
 }
 
+int VfsApply(sqlite3_vfs *vfs,
+	     const char *filename,
+	     unsigned n,
+	     unsigned long *page_numbers,
+	     void *frames)
+{
+	tracef("vfs apply filename %s n %u", filename, n);
+	struct vfs *v;
+	struct vfsDatabase *database;
+
+	v = (struct vfs *)(vfs->pAppData);
+	database = vfsDatabaseLookup(v, filename);
+
+	assert(database != NULL);
+
+	return vfsDatabaseApply(database, n, page_numbers, NULL, frames, NULL);
+}
+
+int VfsApplyBorrowed(sqlite3_vfs *vfs,
+		     const char *filename,
+		     unsigned n,
+		     const void *page_numbers,
+		     void *pages,
+		     vfs_release_cb release_cb,
+		     void *arg)
+{
+	tracef("vfs apply borrowed filename %s n %u", filename, n);
+	struct vfs *v;
+	struct vfsDatabase *database;
+	struct vfsWal *wal;
+	struct vfsLoan *loan;
+	int rv;
+
+	assert(n > 0);
+	assert(release_cb != NULL);
+
+	v = (struct vfs *)(vfs->pAppData);
+	database = vfsDatabaseLookup(v, filename);
+
+	assert(database != NULL);
+
+	wal = &database->wal;
+
+	if (wal->n_loans == wal->cap_loans) {
+		unsigned cap = wal->cap_loans > 0 ? wal->cap_loans * 2
+						  : VFS__FRAMES_MIN_CAP;
+		struct vfsLoan *loans =
+		    sqlite3_realloc64(wal->loans, sizeof *loans * cap);
+		if (loans == NULL) {
+			return DQLITE_NOMEM;
+		}
+		wal->loans = loans;
+		wal->cap_loans = cap;
+	}
+
+	loan = &wal->loans[wal->n_loans];
+	loan->frames = sqlite3_malloc64(sizeof *loan->frames * n);
+	if (loan->frames == NULL) {
+		return DQLITE_NOMEM;
+	}
+	loan->release_cb = release_cb;
+	loan->arg = arg;
+
+	rv = vfsDatabaseApply(database, n, NULL, page_numbers, pages, loan);
+	if (rv != 0) {
+		sqlite3_free(loan->frames);
+		return rv;
+	}
+	wal->n_loans++;
+
+	return 0;
+}
+
+/* Replace the borrowed pages of the WAL with private copies, and hand back
+ * the memory they were referencing. */
+static int vfsWalCopyBorrowed(struct vfsWal *w)
+{
+	struct vfsFrame **copies;
+	uint32_t page_size;
+	unsigned i;
+
+	if (w->n_loans == 0) {
+		return 0;
+	}
+
+	page_size = vfsWalGetPageSize(w);
+	assert(page_size > 0);
+
+	/* Allocate all the copies upfront, so a failure leaves the WAL
+	 * untouched. */
+	copies = sqlite3_malloc64(sizeof *copies * w->n_frames);
+	if (copies == NULL) {
+		return DQLITE_NOMEM;
+	}
+	for (i = 0; i < w->n_frames; i++) {
+		copies[i] = NULL;
+		if (!w->frames[i]->borrowed) {
+			continue;
+		}
+		copies[i] = vfsWalFrameAlloc(w, page_size);
+		if (copies[i] == NULL) {
+			goto oom_after_copies_alloc;
+		}
+	}
+
+	for (i = 0; i < w->n_frames; i++) {
+		struct vfsFrame *frame = w->frames[i];
+		if (copies[i] == NULL) {
+			continue;
+		}
+		memcpy(copies[i]->header, frame->header,
+		       VFS__FRAME_HEADER_SIZE);
+		memcpy(copies[i]->page, frame->page, page_size);
+		w->frames[i] = copies[i];
+	}
+	sqlite3_free(copies);
+
+	vfsWalReleaseLoans(w);
+
+	return 0;
+
+oom_after_copies_alloc:
+	while (i > 0) {
+		i--;
+		if (copies[i] != NULL) {
+			vfsWalFrameRelease(w, copies[i]);
+		}
+	}
+	sqlite3_free(copies);
+	return DQLITE_NOMEM;
+}
+
+int VfsReleaseBorrowed(sqlite3_vfs *vfs)
+{
+	tracef("vfs release borrowed");
+	struct vfs *v;
+	unsigned i;
+	int rv;
+
+	v = (struct vfs *)(vfs->pAppData);
+
+	for (i = 0; i < v->n_databases; i++) {
+		rv = vfsWalCopyBorrowed(&v->databases[i]->wal);
+		if (rv != 0) {
+			tracef("copy borrowed pages failed %d", rv);
+			return rv;
+		}
+	}
+
+	return 0;
+}
+
 int VfsAbort(sqlite3_vfs *vfs, const char *filename)
 {
 	tracef("vfs abort filename %s", filename);
@@ -2426,6 +2959,11 @@ int VfsAbort(sqlite3_vfs *vfs, const char *filename)
 		return DQLITE_ERROR;
 	}
 
+	/* Drop a committed transaction that was not polled yet. */
+	if (vfsWalCommittedTx(&database->wal) > 0) {
+		vfsWalDropTx(&database->wal);
+	}
+
 	rv = vfsShmUnlock(&database->shm, 0, 1, SQLITE_SHM_EXCLUSIVE);
 	if (rv != 0) {
 		tracef("shm unlock failed %d", rv);
@@ -2609,14 +3147,19 @@ static int vfsDatabaseRestore(struct vfsDatabase *d,
 			      size_t n)
 {
 	uint32_t page_size = vfsParsePageSize(ByteGetBe16(&data[16]));
+	struct vfsArena arena;
 	unsigned n_pages;
 	void **pages;
 	unsigned i;
 	size_t offset;
-	int rv;
 
 	assert(page_size > 0);
 
+	/* The WAL must have been truncated already, so the only live pages in
+	 * the current arena are the ones of the main database. */
+	assert(d->wal.n_frames == 0);
+	assert(d->wal.n_tx == 0);
+
 	/* Check that the page size of the snapshot is consistent with what we
 	 * have here. */
 	assert(vfsDatabaseGetPageSize(d) == page_size);
@@ -2632,13 +3175,12 @@ static int vfsDatabaseRestore(struct vfsDatabase *d,
 		goto oom;
 	}
 
+	/* Fill a brand new arena, so the memory of the old content can be
+	 * released as a whole once the restore succeeds. */
+	vfsArenaInit(&arena);
 	for (i = 0; i < n_pages; i++) {
-		void *page = sqlite3_malloc64(page_size);
+		void *page = vfsArenaGet(&arena, page_size);
 		if (page == NULL) {
-			unsigned j;
-			for (j = 0; j < i; j++) {
-				sqlite3_free(pages[j]);
-			}
 			goto oom_after_pages_alloc;
 		}
 		pages[i] = page;
@@ -2646,16 +3188,22 @@ static int vfsDatabaseRestore(struct vfsDatabase *d,
 		memcpy(page, &data[offset], page_size);
 	}
 
-	/* Truncate any existing content. */
-	rv = vfsDatabaseTruncate(d, 0);
-	assert(rv == 0);
+	/* Drop any existing content. Released WAL frames are backed by the old
+	 * arena too, so they can't be reused. */
+	if (d->pages != NULL) {
+		sqlite3_free(d->pages);
+	}
+	vfsWalPoolTrim(&d->wal, 0);
+	vfsArenaClose(&d->arena);
 
+	d->arena = arena;
 	d->pages = pages;
 	d->n_pages = n_pages;
 
 	return 0;
 
 oom_after_pages_alloc:
+	vfsArenaClose(&arena);
 	sqlite3_free(pages);
 oom:
 	return DQLITE_NOMEM;
@@ -2691,13 +3239,13 @@ static int vfsWalRestore(struct vfsWal *w,
 	}
 
 	for (i = 0; i < n_frames; i++) {
-		struct vfsFrame *frame = vfsFrameCreate(page_size);
+		struct vfsFrame *frame = vfsWalFrameAlloc(w, page_size);
 		const uint8_t *p;
 
 		if (frame == NULL) {
 			unsigned j;
 			for (j = 0; j < i; j++) {
-				vfsFrameDestroy(frames[j]);
+				vfsWalFrameRelease(w, frames[j]);
 			}
 			goto oom_after_frames_alloc;
 		}
@@ -2715,8 +3263,12 @@ static int vfsWalRestore(struct vfsWal *w,
 	rv = vfsWalTruncate(w, 0);
 	assert(rv == 0);
 
+	if (w->frames != NULL) {
+		sqlite3_free(w->frames);
+	}
 	w->frames = frames;
 	w->n_frames = n_frames;
+	w->cap_frames = n_frames;
 
 	return 0;
 
@@ -3605,3 +4157,30 @@ uint64_t VfsDatabaseSizeLimit(sqlite3_vfs *vfs)
 	(void)vfs;
 	return (uint64_t)SIZE_MAX;
 }
+
+uint64_t VfsResidentSize(sqlite3_vfs *vfs)
+{
+	struct vfs *v;
+	uint64_t size = 0;
+	unsigned i;
+
+	v = (struct vfs *)(vfs->pAppData);
+	for (i = 0; i < v->n_databases; i++) {
+		size += (uint64_t)v->databases[i]->arena.resident;
+	}
+	return size;
+}
+
+void VfsSetFramePoolCap(sqlite3_vfs *vfs, unsigned n)
+{
+	struct vfs *v;
+	unsigned i;
+
+	v = (struct vfs *)(vfs->pAppData);
+	v->frame_pool_cap = n;
+	for (i = 0; i < v->n_databases; i++) {
+		struct vfsWal *wal = &v->databases[i]->wal;
+		wal->max_pool = n;
+		vfsWalPoolTrim(wal, n);
+	}
+}
@@ -25,6 +25,20 @@ int VfsPoll(sqlite3_vfs *vfs,
 	    dqlite_vfs_frame **frames,
 	    unsigned *n);
 
+/* Set n to the number of frames written by the last sqlite3_step() call, if it
+ * triggered a write transaction, or to zero otherwise. The frames stay in the
+ * WAL until VfsPollInto() or VfsAbort() is called. */
+int VfsPollCount(sqlite3_vfs *vfs, const char *filename, unsigned *n);
+
+/* Like VfsPoll(), but copy the content of the n frames returned by
+ * VfsPollCount() directly into the given buffers: page_numbers receives n
+ * 64-bit little-endian integers and pages receives n pages, back to back. */
+int VfsPollInto(sqlite3_vfs *vfs,
+		const char *filename,
+		unsigned n,
+		void *page_numbers,
+		void *pages);
+
 /* Append the given frames to the WAL. */
 int VfsApply(sqlite3_vfs *vfs,
 	     const char *filename,
@@ -32,7 +46,30 @@ int VfsApply(sqlite3_vfs *vfs,
 	     unsigned long *page_numbers,
 	     void *frames);
 
-/* Cancel a pending transaction. */
+/* Callback invoked when the VFS doesn't need memory lent by
+ * VfsApplyBorrowed() anymore. */
+typedef void (*vfs_release_cb)(void *arg);
+
+/* Like VfsApply(), but let the WAL reference the given pages instead of
+ * copying them. The pages must stay valid and unchanged until release_cb is
+ * invoked with the given arg, which happens at the next checkpoint, or when
+ * the database gets restored or closed. page_numbers holds n 64-bit
+ * little-endian integers, laid out as in VfsPollInto(). If an error is
+ * returned, the memory is not retained and release_cb is not invoked. */
+int VfsApplyBorrowed(sqlite3_vfs *vfs,
+		     const char *filename,
+		     unsigned n,
+		     const void *page_numbers,
+		     void *pages,
+		     vfs_release_cb release_cb,
+		     void *arg);
+
+/* Make private copies of all pages referenced via VfsApplyBorrowed(), and
+ * invoke all pending release callbacks. */
+int VfsReleaseBorrowed(sqlite3_vfs *vfs);
+
+/* Cancel a pending transaction, dropping its frames if they were not polled
+ * yet. */
 int VfsAbort(sqlite3_vfs *vfs, const char *filename);
 
 /* Make a full snapshot of a database. */
@@ -84,4 +121,12 @@ uint64_t VfsDatabaseSize(sqlite3_vfs *vfs,
 /* Returns the the maximum size of the main file and wal file. */
 uint64_t VfsDatabaseSizeLimit(sqlite3_vfs *vfs);
 
+/* Returns the number of bytes reserved for database pages and committed WAL
+ * frames across all in-memory databases of the VFS. */
+uint64_t VfsResidentSize(sqlite3_vfs *vfs);
+
+/* Set the maximum number of WAL frames released by a checkpoint that each
+ * database keeps around for reuse by later transactions. */
+void VfsSetFramePoolCap(sqlite3_vfs *vfs, unsigned n);
+
 #endif /* VFS_H_ */
@@ -1,4 +1,5 @@
 #include "vfs2.h"
+#include "checksum.h"
 
 #include "lib/byte.h"
 #include "lib/queue.h"
@@ -174,16 +175,10 @@ static void update_cksums(uint32_t magic, const uint8_t *p, size_t len, struct c
 {
 	PRE(magic == BE_MAGIC || magic == LE_MAGIC);
 	PRE(len % 8 == 0);
-	const uint8_t *end = p + len;
-	for (; p != end; p += 8) {
-		if (magic == BE_MAGIC) {
-			sums->cksum1 += ByteGetBe32(p) + sums->cksum2;
-			sums->cksum2 += ByteGetBe32(p + 4) + sums->cksum1;
-		} else {
-			sums->cksum1 += ByteGetLe32(p) + sums->cksum2;
-			sums->cksum2 += ByteGetLe32(p + 4) + sums->cksum1;
-		}
-	}
+	uint32_t s[2] = { sums->cksum1, sums->cksum2 };
+	ChecksumWal(magic == native_magic(), p, len, s);
+	sums->cksum1 = s[0];
+	sums->cksum2 = s[1];
 }
 
 static bool cksums_equal(struct cksums a, struct cksums b)
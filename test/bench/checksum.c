@@ -0,0 +1,90 @@
+/* Measure the throughput of the WAL checksum implementations supported by this
+ * host, for every valid page size.
+ *
+ * Usage: checksum-bench [SECONDS_PER_RUN] */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "../../src/checksum.h"
+
+#define PAGE_SIZE_MIN 512
+#define PAGE_SIZE_MAX 65536
+
+/* Number of pages checksummed between two clock readings. */
+#define BATCH 64
+
+static double now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+/* Checksum pages of the given size for the given amount of time, and return
+ * the throughput in MiB/s. */
+static double run(enum checksum_impl impl,
+		  const uint8_t *buf,
+		  size_t page_size,
+		  double seconds)
+{
+	uint32_t sums[2] = {0, 0};
+	uint64_t n_bytes = 0;
+	double start = now();
+	double elapsed;
+	unsigned i;
+
+	do {
+		for (i = 0; i < BATCH; i++) {
+			ChecksumWalWith(impl, true, buf, page_size, sums);
+		}
+		n_bytes += BATCH * page_size;
+		elapsed = now() - start;
+	} while (elapsed < seconds);
+
+	/* Keep the result alive. */
+	if (sums[0] == 0 && sums[1] == 0) {
+		fprintf(stderr, "unlikely checksum\n");
+	}
+
+	return (double)n_bytes / elapsed / (1024 * 1024);
+}
+
+int main(int argc, char *argv[])
+{
+	double seconds = 0.2;
+	uint8_t *buf;
+	size_t page_size;
+	size_t i;
+	enum checksum_impl impl;
+
+	if (argc > 1) {
+		seconds = atof(argv[1]);
+	}
+
+	buf = malloc(PAGE_SIZE_MAX);
+	if (buf == NULL) {
+		return 1;
+	}
+	srand(1);
+	for (i = 0; i < PAGE_SIZE_MAX; i++) {
+		buf[i] = (uint8_t)rand();
+	}
+
+	printf("%-8s %10s %12s\n", "impl", "page_size", "MiB/s");
+	for (impl = 0; impl < CHECKSUM_N_IMPL; impl++) {
+		if (!ChecksumImplSupported(impl)) {
+			continue;
+		}
+		for (page_size = PAGE_SIZE_MIN; page_size <= PAGE_SIZE_MAX;
+		     page_size *= 2) {
+			printf("%-8s %10zu %12.1f\n", ChecksumImplName(impl),
+			       page_size, run(impl, buf, page_size, seconds));
+		}
+	}
+
+	free(buf);
+	return 0;
+}
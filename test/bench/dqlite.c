@@ -0,0 +1,861 @@
+/* End-to-end benchmark: start a cluster of in-process dqlite nodes and drive
+ * it through the client protocol.
+ *
+ * Usage: dqlite-bench [-n NODES] [-t unix|tcp] [-p PORT] [-c CLIENTS]
+ *                     [-d SECONDS] [-r ROWS] [-b BATCH] [-s SCAN]
+ *                     [-m READ_PERCENT] [-M] [WORKLOAD...]
+ *
+ * The selected workloads, all of them by default, are run one after the other
+ * against the same cluster, in this order:
+ *
+ * - insert: one single-row INSERT per transaction;
+ * - batch:  one multi-row INSERT of BATCH rows per transaction;
+ * - read:   point SELECTs by primary key;
+ * - scan:   range SELECTs of SCAN rows;
+ * - mixed:  READ_PERCENT point SELECTs, single-row INSERTs otherwise.
+ *
+ * Each workload prints a JSON object on a line of its own on stdout, holding
+ * the throughput and the latency percentiles of its operations. Operations
+ * that fail with SQLITE_BUSY because another client holds the write lock are
+ * retried, and the latency includes the retries. With -M, the
+ * metrics of the leader are printed as one more JSON object at the end. */
+
+#include <arpa/inet.h>
+#include <ftw.h>
+#include <getopt.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../../include/dqlite.h"
+#include "../../src/client/protocol.h"
+
+#define MAX_NODES 5
+#define MAX_CLIENTS 64
+#define MAX_BATCH 1000
+#define DB_NAME "bench"
+
+/* Give up if the cluster isn't ready after this many attempts, spaced by
+ * 10 milliseconds. */
+#define MAX_ATTEMPTS 1000
+
+enum workload {
+	WORKLOAD_INSERT,
+	WORKLOAD_BATCH,
+	WORKLOAD_READ,
+	WORKLOAD_SCAN,
+	WORKLOAD_MIXED,
+	N_WORKLOADS
+};
+
+static const char *workloadNames[N_WORKLOADS] = {
+	[WORKLOAD_INSERT] = "insert", [WORKLOAD_BATCH] = "batch",
+	[WORKLOAD_READ] = "read",     [WORKLOAD_SCAN] = "scan",
+	[WORKLOAD_MIXED] = "mixed",
+};
+
+struct options
+{
+	unsigned n_nodes;
+	bool tcp;
+	unsigned port;
+	unsigned n_clients;
+	double seconds;
+	unsigned rows;
+	unsigned batch;
+	unsigned scan;
+	unsigned read_percent;
+	bool metrics;
+};
+
+struct node
+{
+	dqlite_node_id id;
+	char address[64];
+	dqlite_node *dqlite;
+};
+
+/* Latency samples of a single client, in nanoseconds. */
+struct samples
+{
+	uint64_t *values;
+	size_t n;
+	size_t cap;
+};
+
+struct client
+{
+	pthread_t thread;
+	unsigned index;
+	const struct options *options;
+	const char *address;
+	enum workload workload;
+	struct client_proto proto;
+	uint32_t insert;  /* Single-row insert statement */
+	uint32_t batch;   /* Multi-row insert statement */
+	uint32_t read;    /* Point read statement */
+	uint32_t scan;    /* Range scan statement */
+	uint64_t seed;    /* State of the key generator */
+	uint64_t key;     /* First key of the pending insert, if any */
+	bool has_key;
+	uint64_t n_rows;  /* Rows written or read */
+	uint64_t n_busy;  /* Operations retried because of SQLITE_BUSY */
+	struct samples samples;
+	int status;
+};
+
+static char dir[] = "/tmp/dqlite-bench-XXXXXX";
+
+/* Next key to insert, shared by all clients. */
+static uint64_t nextKey;
+
+/* Set when the clients must stop issuing requests. */
+static volatile bool stop;
+
+static uint64_t now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + (uint64_t)ts.tv_nsec;
+}
+
+static void die(const char *message)
+{
+	fprintf(stderr, "dqlite-bench: %s\n", message);
+	exit(1);
+}
+
+/* Connect to the given abstract Unix socket or IPv4 address. Used both by the
+ * nodes and by the clients. */
+static int connectFunc(void *arg, const char *address, int *fd)
+{
+	struct sockaddr_un un;
+	struct sockaddr_in in;
+	char host[64];
+	const char *colon;
+	socklen_t len;
+	int one = 1;
+	int rv;
+	(void)arg;
+
+	if (address[0] == '@') {
+		memset(&un, 0, sizeof un);
+		un.sun_family = AF_UNIX;
+		strncpy(un.sun_path + 1, address + 1, sizeof un.sun_path - 2);
+		len = (socklen_t)(sizeof(sa_family_t) + strlen(address));
+		*fd = socket(AF_UNIX, SOCK_STREAM, 0);
+		if (*fd == -1) {
+			return DQLITE_ERROR;
+		}
+		rv = connect(*fd, (struct sockaddr *)&un, len);
+	} else {
+		colon = strchr(address, ':');
+		if (colon == NULL || (size_t)(colon - address) >= sizeof host) {
+			return DQLITE_ERROR;
+		}
+		memset(host, 0, sizeof host);
+		memcpy(host, address, (size_t)(colon - address));
+		memset(&in, 0, sizeof in);
+		in.sin_family = AF_INET;
+		in.sin_port = htons((uint16_t)atoi(colon + 1));
+		if (inet_pton(AF_INET, host, &in.sin_addr) != 1) {
+			return DQLITE_ERROR;
+		}
+		*fd = socket(AF_INET, SOCK_STREAM, 0);
+		if (*fd == -1) {
+			return DQLITE_ERROR;
+		}
+		setsockopt(*fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof one);
+		rv = connect(*fd, (struct sockaddr *)&in, sizeof in);
+	}
+
+	if (rv != 0) {
+		close(*fd);
+		return DQLITE_ERROR;
+	}
+	return 0;
+}
+
+static void sleepMs(unsigned ms)
+{
+	struct timespec ts = { 0, (long)ms * 1000 * 1000 };
+	nanosleep(&ts, NULL);
+}
+
+/******************************************************************************
+ *
+ * Cluster setup.
+ *
+ ******************************************************************************/
+
+static void startNode(struct node *n, const struct options *o, unsigned i)
+{
+	char path[sizeof dir + 16];
+	int rv;
+
+	n->id = i + 1;
+	if (o->tcp) {
+		snprintf(n->address, sizeof n->address, "127.0.0.1:%u",
+			 o->port + i);
+	} else {
+		snprintf(n->address, sizeof n->address, "@dqlite-bench-%d-%u",
+			 (int)getpid(), i + 1);
+	}
+	snprintf(path, sizeof path, "%s/%u", dir, i + 1);
+	if (mkdir(path, 0755) != 0) {
+		die("can't create node directory");
+	}
+
+	rv = dqlite_node_create(n->id, n->address, path, &n->dqlite);
+	if (rv != 0) {
+		die("can't create node");
+	}
+	rv = dqlite_node_set_bind_address(n->dqlite, n->address);
+	if (rv != 0) {
+		die(dqlite_node_errmsg(n->dqlite));
+	}
+	rv = dqlite_node_set_connect_func(n->dqlite, connectFunc, NULL);
+	if (rv != 0) {
+		die(dqlite_node_errmsg(n->dqlite));
+	}
+	rv = dqlite_node_start(n->dqlite);
+	if (rv != 0) {
+		die(dqlite_node_errmsg(n->dqlite));
+	}
+}
+
+static void stopNode(struct node *n)
+{
+	dqlite_node_stop(n->dqlite);
+	dqlite_node_destroy(n->dqlite);
+}
+
+static void clientConnect(struct client_proto *c, const char *address)
+{
+	int rv;
+
+	memset(c, 0, sizeof *c);
+	c->connect = connectFunc;
+	c->fd = -1;
+	rv = clientOpen(c, address, 0);
+	if (rv != 0) {
+		die("can't connect to the leader");
+	}
+	rv = clientSendHandshake(c, NULL);
+	if (rv != 0) {
+		die("handshake failed");
+	}
+}
+
+/* Wait for the first node to win the election, then add the other ones as
+ * voters. */
+static void formCluster(struct node *nodes, unsigned n_nodes)
+{
+	struct client_proto c;
+	uint64_t id = 0;
+	char *address = NULL;
+	unsigned i;
+	unsigned attempt;
+	int rv;
+
+	clientConnect(&c, nodes[0].address);
+	for (attempt = 0; id != nodes[0].id; attempt++) {
+		if (attempt == MAX_ATTEMPTS) {
+			die("no leader elected");
+		}
+		sleepMs(10);
+		rv = clientSendLeader(&c, NULL);
+		if (rv == 0) {
+			rv = clientRecvServer(&c, &id, &address, NULL);
+		}
+		if (rv != 0) {
+			die("can't query the leader");
+		}
+		free(address);
+	}
+
+	for (i = 1; i < n_nodes; i++) {
+		rv = clientSendAdd(&c, nodes[i].id, nodes[i].address, NULL);
+		if (rv == 0) {
+			rv = clientRecvEmpty(&c, NULL);
+		}
+		if (rv != 0) {
+			die("can't add node");
+		}
+		rv = clientSendAssign(&c, nodes[i].id, DQLITE_VOTER, NULL);
+		if (rv == 0) {
+			rv = clientRecvEmpty(&c, NULL);
+		}
+		if (rv != 0) {
+			die("can't promote node");
+		}
+	}
+
+	clientClose(&c);
+}
+
+static int removeFn(const char *path,
+		    const struct stat *sb,
+		    int type,
+		    struct FTW *ftwb)
+{
+	(void)sb;
+	(void)type;
+	(void)ftwb;
+	return remove(path);
+}
+
+/******************************************************************************
+ *
+ * Clients.
+ *
+ ******************************************************************************/
+
+static uint32_t prepare(struct client *c, const char *sql)
+{
+	uint32_t stmt_id;
+	int rv;
+
+	rv = clientSendPrepare(&c->proto, sql, NULL);
+	if (rv == 0) {
+		rv = clientRecvStmt(&c->proto, &stmt_id, NULL, NULL, NULL);
+	}
+	if (rv != 0) {
+		die("prepare failed");
+	}
+	return stmt_id;
+}
+
+static void clientInit(struct client *c)
+{
+	char sql[64 + MAX_BATCH * 8];
+	size_t n;
+	unsigned i;
+	int rv;
+
+	clientConnect(&c->proto, c->address);
+	rv = clientSendOpen(&c->proto, DB_NAME, NULL);
+	if (rv == 0) {
+		rv = clientRecvDb(&c->proto, NULL);
+	}
+	if (rv != 0) {
+		die("open failed");
+	}
+
+	c->insert = prepare(c, "INSERT INTO bench(k, v) VALUES(?, ?)");
+	n = (size_t)snprintf(sql, sizeof sql,
+			     "INSERT INTO bench(k, v) VALUES(?, ?)");
+	for (i = 1; i < c->options->batch; i++) {
+		n += (size_t)snprintf(sql + n, sizeof sql - n, ", (?, ?)");
+	}
+	c->batch = prepare(c, sql);
+	c->read = prepare(c, "SELECT v FROM bench WHERE k = ?");
+	c->scan = prepare(c,
+			  "SELECT k, v FROM bench WHERE k >= ? ORDER BY k "
+			  "LIMIT ?");
+	c->seed = c->index * 2654435761u + 1;
+}
+
+/* Random number generator, xorshift64. */
+static uint64_t randomKey(struct client *c, uint64_t n)
+{
+	c->seed ^= c->seed << 13;
+	c->seed ^= c->seed >> 7;
+	c->seed ^= c->seed << 17;
+	return n == 0 ? 0 : c->seed % n;
+}
+
+static int exec(struct client *c,
+		uint32_t stmt_id,
+		struct value *params,
+		unsigned n_params)
+{
+	uint64_t last_insert_id;
+	uint64_t rows_affected;
+	int rv;
+
+	rv = clientSendExec(&c->proto, stmt_id, params, n_params, NULL);
+	if (rv != 0) {
+		return rv;
+	}
+	rv = clientRecvResult(&c->proto, &last_insert_id, &rows_affected,
+			      NULL);
+	if (rv != 0) {
+		return rv;
+	}
+	c->n_rows += rows_affected;
+	return 0;
+}
+
+static int query(struct client *c,
+		 uint32_t stmt_id,
+		 struct value *params,
+		 unsigned n_params)
+{
+	struct rows rows;
+	struct row *row;
+	bool done = false;
+	int rv;
+
+	rv = clientSendQuery(&c->proto, stmt_id, params, n_params, NULL);
+	if (rv != 0) {
+		return rv;
+	}
+	while (!done) {
+		rv = clientRecvRows(&c->proto, &rows, &done, NULL);
+		if (rv != 0) {
+			return rv;
+		}
+		for (row = rows.next; row != NULL; row = row->next) {
+			c->n_rows++;
+		}
+		clientCloseRows(&rows);
+	}
+	return 0;
+}
+
+static void setRow(struct value *params, uint64_t key)
+{
+	params[0].type = SQLITE_INTEGER;
+	params[0].integer = (int64_t)key;
+	params[1].type = SQLITE_TEXT;
+	params[1].text = "0123456789abcdef0123456789abcdef";
+}
+
+/* Reserve n keys for an insert, unless a previous attempt at it failed. */
+static uint64_t reserveKeys(struct client *c, unsigned n)
+{
+	if (!c->has_key) {
+		c->key = __atomic_fetch_add(&nextKey, n, __ATOMIC_RELAXED);
+		c->has_key = true;
+	}
+	return c->key;
+}
+
+static int insert(struct client *c)
+{
+	struct value params[2];
+	int rv;
+
+	setRow(params, reserveKeys(c, 1));
+	rv = exec(c, c->insert, params, 2);
+	if (rv == 0) {
+		c->has_key = false;
+	}
+	return rv;
+}
+
+static int insertBatch(struct client *c)
+{
+	struct value params[2 * MAX_BATCH];
+	unsigned n = c->options->batch;
+	uint64_t key = reserveKeys(c, n);
+	unsigned i;
+	int rv;
+
+	for (i = 0; i < n; i++) {
+		setRow(&params[2 * i], key + i);
+	}
+	rv = exec(c, c->batch, params, 2 * n);
+	if (rv == 0) {
+		c->has_key = false;
+	}
+	return rv;
+}
+
+static int readOne(struct client *c)
+{
+	struct value params[1];
+	params[0].type = SQLITE_INTEGER;
+	params[0].integer = (int64_t)randomKey(
+	    c, __atomic_load_n(&nextKey, __ATOMIC_RELAXED));
+	return query(c, c->read, params, 1);
+}
+
+static int scan(struct client *c)
+{
+	struct value params[2];
+	params[0].type = SQLITE_INTEGER;
+	params[0].integer = (int64_t)randomKey(
+	    c, __atomic_load_n(&nextKey, __ATOMIC_RELAXED));
+	params[1].type = SQLITE_INTEGER;
+	params[1].integer = c->options->scan;
+	return query(c, c->scan, params, 2);
+}
+
+static int step(struct client *c)
+{
+	switch (c->workload) {
+		case WORKLOAD_INSERT:
+			return insert(c);
+		case WORKLOAD_BATCH:
+			return insertBatch(c);
+		case WORKLOAD_READ:
+			return readOne(c);
+		case WORKLOAD_SCAN:
+			return scan(c);
+		case WORKLOAD_MIXED:
+			if (randomKey(c, 100) < c->options->read_percent) {
+				return readOne(c);
+			}
+			return insert(c);
+		default:
+			return DQLITE_ERROR;
+	}
+}
+
+static void record(struct samples *s, uint64_t value)
+{
+	if (s->n == s->cap) {
+		s->cap = s->cap == 0 ? 4096 : s->cap * 2;
+		s->values = realloc(s->values, s->cap * sizeof *s->values);
+		if (s->values == NULL) {
+			die("out of memory");
+		}
+	}
+	s->values[s->n++] = value;
+}
+
+static bool isBusy(struct client *c)
+{
+	return c->status == DQLITE_CLIENT_PROTO_RECEIVED_FAILURE &&
+	       (c->proto.errcode & 0xff) == SQLITE_BUSY;
+}
+
+static void *clientRun(void *arg)
+{
+	struct client *c = arg;
+	uint64_t start;
+
+	while (!stop) {
+		start = now();
+		for (;;) {
+			c->status = step(c);
+			if (!isBusy(c) || stop) {
+				break;
+			}
+			c->n_busy++;
+		}
+		if (c->status != 0) {
+			if (isBusy(c)) {
+				/* Stopped while retrying. */
+				c->status = 0;
+			}
+			break;
+		}
+		record(&c->samples, now() - start);
+	}
+	return NULL;
+}
+
+/******************************************************************************
+ *
+ * Reporting.
+ *
+ ******************************************************************************/
+
+static int compareSamples(const void *a, const void *b)
+{
+	uint64_t x = *(const uint64_t *)a;
+	uint64_t y = *(const uint64_t *)b;
+	return x < y ? -1 : x > y;
+}
+
+/* Nearest-rank percentile of sorted samples, in microseconds. */
+static double percentile(const struct samples *s, unsigned permille)
+{
+	size_t rank;
+	if (s->n == 0) {
+		return 0;
+	}
+	rank = (s->n * permille + 999) / 1000;
+	if (rank == 0) {
+		rank = 1;
+	}
+	return (double)s->values[rank - 1] / 1000;
+}
+
+static void report(const struct options *o,
+		   enum workload workload,
+		   struct client *clients,
+		   double elapsed)
+{
+	struct samples all = { NULL, 0, 0 };
+	uint64_t n_rows = 0;
+	uint64_t n_busy = 0;
+	unsigned i;
+	size_t j;
+
+	for (i = 0; i < o->n_clients; i++) {
+		n_busy += clients[i].n_busy;
+		for (j = 0; j < clients[i].samples.n; j++) {
+			record(&all, clients[i].samples.values[j]);
+		}
+		n_rows += clients[i].n_rows;
+	}
+	if (all.n > 0) {
+		qsort(all.values, all.n, sizeof *all.values, compareSamples);
+	}
+
+	printf("{\"workload\": \"%s\", \"nodes\": %u, \"transport\": \"%s\", "
+	       "\"clients\": %u, \"seconds\": %.3f, \"ops\": %zu, "
+	       "\"ops_per_sec\": %.1f, \"rows_per_sec\": %.1f, \"busy\": %llu, "
+	       "\"latency_us\": {\"p50\": %.1f, \"p99\": %.1f, "
+	       "\"p999\": %.1f, \"max\": %.1f}}\n",
+	       workloadNames[workload], o->n_nodes, o->tcp ? "tcp" : "unix",
+	       o->n_clients, elapsed, all.n, (double)all.n / elapsed,
+	       (double)n_rows / elapsed, (unsigned long long)n_busy,
+	       percentile(&all, 500),
+	       percentile(&all, 990), percentile(&all, 999),
+	       percentile(&all, 1000));
+	fflush(stdout);
+
+	free(all.values);
+}
+
+static void reportMetrics(const char *address)
+{
+	struct client_proto c;
+	struct client_metric *metrics;
+	size_t n;
+	size_t i;
+	int rv;
+
+	clientConnect(&c, address);
+	rv = clientSendMetrics(&c, NULL);
+	if (rv == 0) {
+		rv = clientRecvMetrics(&c, &metrics, &n, NULL);
+	}
+	if (rv != 0) {
+		die("can't retrieve metrics");
+	}
+	clientClose(&c);
+
+	printf("{\"metrics\": {");
+	for (i = 0; i < n; i++) {
+		printf("%s\"%s\": %llu", i == 0 ? "" : ", ", metrics[i].name,
+		       (unsigned long long)metrics[i].value);
+		free(metrics[i].name);
+	}
+	printf("}}\n");
+	free(metrics);
+}
+
+/******************************************************************************
+ *
+ * Main.
+ *
+ ******************************************************************************/
+
+static void run(const struct options *o,
+		const char *address,
+		enum workload workload)
+{
+	struct client *clients = calloc(o->n_clients, sizeof *clients);
+	uint64_t start;
+	unsigned i;
+
+	if (clients == NULL) {
+		die("out of memory");
+	}
+	for (i = 0; i < o->n_clients; i++) {
+		clients[i].index = i;
+		clients[i].options = o;
+		clients[i].address = address;
+		clients[i].workload = workload;
+		clientInit(&clients[i]);
+	}
+
+	stop = false;
+	start = now();
+	for (i = 0; i < o->n_clients; i++) {
+		if (pthread_create(&clients[i].thread, NULL, clientRun,
+				   &clients[i]) != 0) {
+			die("can't start client thread");
+		}
+	}
+	while ((double)(now() - start) / 1e9 < o->seconds) {
+		sleepMs(10);
+	}
+	stop = true;
+	for (i = 0; i < o->n_clients; i++) {
+		pthread_join(clients[i].thread, NULL);
+		if (clients[i].status != 0) {
+			fprintf(stderr, "dqlite-bench: %s: client %u: %s\n",
+				workloadNames[workload], i,
+				clients[i].proto.errmsg != NULL
+				    ? clients[i].proto.errmsg
+				    : "request failed");
+		}
+	}
+
+	report(o, workload, clients, (double)(now() - start) / 1e9);
+
+	for (i = 0; i < o->n_clients; i++) {
+		clientClose(&clients[i].proto);
+		free(clients[i].samples.values);
+	}
+	free(clients);
+}
+
+/* Create the table and fill it with the initial rows. */
+static void populate(const struct options *o, const char *address)
+{
+	struct options batch = *o;
+	struct client c;
+	uint64_t last_insert_id;
+	uint64_t rows_affected;
+	int rv;
+
+	memset(&c, 0, sizeof c);
+	batch.batch = o->batch > 0 ? o->batch : 1;
+	c.options = &batch;
+	c.address = address;
+
+	clientConnect(&c.proto, address);
+	rv = clientSendOpen(&c.proto, DB_NAME, NULL);
+	if (rv == 0) {
+		rv = clientRecvDb(&c.proto, NULL);
+	}
+	if (rv == 0) {
+		rv = clientSendExecSQL(
+		    &c.proto,
+		    "CREATE TABLE bench (k INTEGER PRIMARY KEY, v TEXT)", NULL,
+		    0, NULL);
+	}
+	if (rv == 0) {
+		rv = clientRecvResult(&c.proto, &last_insert_id,
+				      &rows_affected, NULL);
+	}
+	if (rv != 0) {
+		die("can't create table");
+	}
+	clientClose(&c.proto);
+
+	clientInit(&c);
+	while (nextKey < o->rows) {
+		if (insertBatch(&c) != 0) {
+			die("can't populate table");
+		}
+	}
+	clientClose(&c.proto);
+}
+
+static void usage(void)
+{
+	fprintf(stderr,
+		"usage: dqlite-bench [-n NODES] [-t unix|tcp] [-p PORT] "
+		"[-c CLIENTS] [-d SECONDS] [-r ROWS] [-b BATCH] [-s SCAN] "
+		"[-m READ_PERCENT] [-M] [insert|batch|read|scan|mixed...]\n");
+	exit(2);
+}
+
+int main(int argc, char *argv[])
+{
+	struct options o = {
+		.n_nodes = 1,
+		.tcp = false,
+		.port = 9101,
+		.n_clients = 1,
+		.seconds = 5,
+		.rows = 10000,
+		.batch = 100,
+		.scan = 100,
+		.read_percent = 90,
+		.metrics = false,
+	};
+	bool selected[N_WORKLOADS] = { false };
+	bool any = false;
+	struct node nodes[MAX_NODES];
+	int opt;
+	int i;
+	unsigned j;
+
+	while ((opt = getopt(argc, argv, "n:t:p:c:d:r:b:s:m:M")) != -1) {
+		switch (opt) {
+			case 'n':
+				o.n_nodes = (unsigned)atoi(optarg);
+				break;
+			case 't':
+				o.tcp = strcmp(optarg, "tcp") == 0;
+				break;
+			case 'p':
+				o.port = (unsigned)atoi(optarg);
+				break;
+			case 'c':
+				o.n_clients = (unsigned)atoi(optarg);
+				break;
+			case 'd':
+				o.seconds = atof(optarg);
+				break;
+			case 'r':
+				o.rows = (unsigned)atoi(optarg);
+				break;
+			case 'b':
+				o.batch = (unsigned)atoi(optarg);
+				break;
+			case 's':
+				o.scan = (unsigned)atoi(optarg);
+				break;
+			case 'm':
+				o.read_percent = (unsigned)atoi(optarg);
+				break;
+			case 'M':
+				o.metrics = true;
+				break;
+			default:
+				usage();
+		}
+	}
+	if (o.n_nodes < 1 || o.n_nodes > MAX_NODES || o.n_clients < 1 ||
+	    o.n_clients > MAX_CLIENTS || o.batch < 1 || o.batch > MAX_BATCH ||
+	    o.read_percent > 100) {
+		usage();
+	}
+	for (i = optind; i < argc; i++) {
+		for (j = 0; j < N_WORKLOADS; j++) {
+			if (strcmp(argv[i], workloadNames[j]) == 0) {
+				selected[j] = true;
+				any = true;
+				break;
+			}
+		}
+		if (j == N_WORKLOADS) {
+			usage();
+		}
+	}
+
+	if (mkdtemp(dir) == NULL) {
+		die("can't create data directory");
+	}
+	for (j = 0; j < o.n_nodes; j++) {
+		startNode(&nodes[j], &o, j);
+	}
+	formCluster(nodes, o.n_nodes);
+
+	populate(&o, nodes[0].address);
+	for (j = 0; j < N_WORKLOADS; j++) {
+		if (!any || selected[j]) {
+			run(&o, nodes[0].address, j);
+		}
+	}
+	if (o.metrics) {
+		reportMetrics(nodes[0].address);
+	}
+
+	for (j = o.n_nodes; j > 0; j--) {
+		stopNode(&nodes[j - 1]);
+	}
+	nftw(dir, removeFn, 10, FTW_DEPTH | FTW_PHYS);
+
+	return 0;
+}
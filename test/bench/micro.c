@@ -0,0 +1,829 @@
+/* Microbenchmarks of the hot paths that don't involve the network: the
+ * replication hooks of the in-memory VFS, database snapshots, the tuple codec,
+ * the raft command codec and the encoding of query results.
+ *
+ * Usage: micro-bench [-t SECONDS] [-r RUNS] [GROUP...]
+ *
+ * The selected groups, all of them by default, are run in this order:
+ *
+ * - vfs:      VfsPollCount() plus VfsPollInto(), and VfsApply(), of write
+ *             transactions of 1, 16 and 256 pages, with page sizes of 512,
+ *             4096 and 32768 bytes (the largest size the VFS supports);
+ * - snapshot: VfsSnapshot() and VfsRestore() of a database of about 1024
+ *             pages, with the same page sizes;
+ * - tuple:    tuple_encoder__next() and tuple_decoder__next() on rows of 1, 8
+ *             and 32 columns of mixed types;
+ * - command:  command__encode() and command__decode() of COMMAND_FRAMES
+ *             commands carrying 1, 16 and 256 pages of 4096 bytes;
+ * - query:    query__batch() over tables of 1, 8 and 32 columns.
+ *
+ * Only the named function is timed, the work needed to set up each operation
+ * (e.g. running the SQL that triggers a write transaction) is not. Every case
+ * is run RUNS times for at least SECONDS of measured time, and the fastest run
+ * is reported. The tuple and query operations are single rows.
+ *
+ * The output is a JSON array holding one object per case, on a line of its
+ * own, made of the benchmark name and its parameters followed by "ops",
+ * "ns_per_op" and "mib_per_sec". The order of cases and keys is stable, so
+ * that the output of two builds can be compared line by line. */
+
+#include <getopt.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../../include/dqlite.h"
+#include "../../src/command.h"
+#include "../../src/lib/buffer.h"
+#include "../../src/lib/byte.h"
+#include "../../src/lib/serialize.h"
+#include "../../src/query.h"
+#include "../../src/raft.h"
+#include "../../src/tuple.h"
+#include "../../src/vfs.h"
+
+#define VFS_NAME "micro-bench"
+
+/* A run gives up once it took this many times the requested measured time,
+ * since setting up operations can be much slower than the operations
+ * themselves. */
+#define WALL_FACTOR 5
+
+/* Frames accumulated in the WAL before it gets checkpointed. */
+#define CHECKPOINT_THRESHOLD 1000
+
+/* Pages in the databases used for snapshots. */
+#define SNAPSHOT_PAGES 1024
+
+/* Rows encoded or decoded by a single tuple operation batch. */
+#define TUPLE_BATCH 64
+
+/* Rows in the tables used by the query benchmark. */
+#define QUERY_ROWS 1000
+
+static const unsigned page_sizes[] = { 512, 4096, 32768 };
+static const unsigned tx_pages[] = { 1, 16, 256 };
+static const unsigned columns[] = { 1, 8, 32 };
+
+struct options
+{
+	uint64_t min_ns; /* Minimum measured time of a run */
+	unsigned runs;   /* Number of runs of each case */
+};
+
+static struct options options;
+static sqlite3_vfs vfs;
+static bool first = true;
+
+/* Result of a run. */
+struct sample
+{
+	uint64_t ops;   /* Number of operations performed */
+	uint64_t bytes; /* Bytes processed by the operations */
+	uint64_t ns;    /* Time spent in the measured section */
+};
+
+/* Perform one or more operations, accounting for them in the given sample. */
+typedef void (*op_fn)(void *arg, struct sample *s);
+
+static uint64_t now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + (uint64_t)ts.tv_nsec;
+}
+
+static void check(int rv, const char *what)
+{
+	if (rv != 0) {
+		fprintf(stderr, "micro-bench: %s: error %d\n", what, rv);
+		exit(1);
+	}
+}
+
+static void mustExec(sqlite3 *db, const char *sql)
+{
+	char *msg = NULL;
+	int rv;
+
+	rv = sqlite3_exec(db, sql, NULL, NULL, &msg);
+	if (rv != SQLITE_OK) {
+		fprintf(stderr, "micro-bench: %s: %s\n", sql, msg);
+		exit(1);
+	}
+}
+
+static void *mustMalloc(size_t size)
+{
+	void *p = malloc(size);
+	if (p == NULL) {
+		check(DQLITE_NOMEM, "malloc");
+	}
+	return p;
+}
+
+static void emit(const char *name, const char *params, const struct sample *s)
+{
+	double ns_per_op = 0;
+	double mib_per_sec = 0;
+
+	if (s->ops > 0) {
+		ns_per_op = (double)s->ns / (double)s->ops;
+	}
+	if (s->ns > 0) {
+		mib_per_sec = (double)s->bytes / ((double)s->ns / 1e9) /
+			      (1024 * 1024);
+	}
+	printf("%s  {\"bench\": \"%s\", %s, \"ops\": %" PRIu64
+	       ", \"ns_per_op\": %.1f, \"mib_per_sec\": %.1f}",
+	       first ? "" : ",\n", name, params, s->ops, ns_per_op,
+	       mib_per_sec);
+	first = false;
+	fflush(stdout);
+}
+
+/* Run a case the configured number of times and emit its fastest run. */
+static void measure(const char *name, const char *params, op_fn op, void *arg)
+{
+	struct sample best = { 0, 0, 0 };
+	unsigned i;
+
+	for (i = 0; i < options.runs; i++) {
+		struct sample s = { 0, 0, 0 };
+		uint64_t start = now();
+		while (s.ns < options.min_ns &&
+		       now() - start < WALL_FACTOR * options.min_ns) {
+			op(arg, &s);
+		}
+		if (best.ops == 0 || s.ns * best.ops < best.ns * s.ops) {
+			best = s;
+		}
+	}
+
+	emit(name, params, &best);
+}
+
+/* A database with a table of rows of about one page each, which gets updated
+ * by write transactions touching a fixed number of rows. */
+struct tx
+{
+	char filename[64];
+	sqlite3 *db;
+	sqlite3_stmt *update;
+	unsigned page_size;
+	unsigned n_rows;         /* Rows updated by each transaction */
+	unsigned round;          /* Number of transactions run so far */
+	void *blob;              /* Value of the updated rows */
+	int blob_size;           /* Size of the blob, just below a page */
+	unsigned cap;            /* Capacity of the buffers below, in frames */
+	uint8_t *page_numbers;   /* Page numbers, as filled by VfsPollInto() */
+	uint8_t *pages;          /* Pages, as filled by VfsPollInto() */
+	unsigned long *numbers;  /* Page numbers, as consumed by VfsApply() */
+	unsigned n;              /* Frames polled from the last transaction */
+	unsigned n_wal;          /* Frames applied since the last checkpoint */
+};
+
+static void txPoll(struct tx *t)
+{
+	check(VfsPollCount(&vfs, t->filename, &t->n), "VfsPollCount");
+	if (t->n > t->cap) {
+		free(t->page_numbers);
+		free(t->pages);
+		free(t->numbers);
+		t->cap = t->n;
+		t->page_numbers = mustMalloc(sizeof(uint64_t) * t->cap);
+		t->pages = mustMalloc((size_t)t->page_size * t->cap);
+		t->numbers = mustMalloc(sizeof *t->numbers * t->cap);
+	}
+	check(VfsPollInto(&vfs, t->filename, t->n, t->page_numbers, t->pages),
+	      "VfsPollInto");
+}
+
+/* Convert the polled page numbers to the layout expected by VfsApply(). */
+static void txDecode(struct tx *t)
+{
+	unsigned i;
+	unsigned j;
+
+	for (i = 0; i < t->n; i++) {
+		uint64_t pgno = 0;
+		for (j = 0; j < sizeof(uint64_t); j++) {
+			pgno |= (uint64_t)t->page_numbers[i * 8 + j] << (8 * j);
+		}
+		t->numbers[i] = (unsigned long)pgno;
+	}
+}
+
+static void txApply(struct tx *t)
+{
+	check(VfsApply(&vfs, t->filename, t->n, t->numbers, t->pages),
+	      "VfsApply");
+}
+
+/* Copy the WAL back into the database once it grew large enough. */
+static void txMaybeCheckpoint(struct tx *t)
+{
+	int log;
+	int ckpt;
+
+	t->n_wal += t->n;
+	if (t->n_wal < CHECKPOINT_THRESHOLD) {
+		return;
+	}
+	check(sqlite3_wal_checkpoint_v2(t->db, "main",
+					SQLITE_CHECKPOINT_TRUNCATE, &log,
+					&ckpt),
+	      "checkpoint");
+	t->n_wal = 0;
+}
+
+/* Run the given SQL and replicate the transaction it triggers, if any. */
+static void txExec(struct tx *t, const char *sql)
+{
+	mustExec(t->db, sql);
+	txPoll(t);
+	txDecode(t);
+	txApply(t);
+	txMaybeCheckpoint(t);
+}
+
+/* Run an UPDATE touching the next n_rows rows, without replicating it. */
+static void txWrite(struct tx *t)
+{
+	sqlite3_int64 start = (sqlite3_int64)((t->round % 2) * t->n_rows);
+	int rv;
+
+	/* Change the content of the rows at every round. */
+	((uint8_t *)t->blob)[0] = (uint8_t)t->round;
+	t->round++;
+
+	sqlite3_bind_blob(t->update, 1, t->blob, t->blob_size, SQLITE_STATIC);
+	sqlite3_bind_int64(t->update, 2, start);
+	sqlite3_bind_int64(t->update, 3, start + t->n_rows);
+	rv = sqlite3_step(t->update);
+	if (rv != SQLITE_DONE) {
+		check(rv, "UPDATE");
+	}
+	sqlite3_reset(t->update);
+}
+
+/* Open a database with the given page size and 2 * n_rows rows. */
+static void txOpen(struct tx *t, unsigned page_size, unsigned n_rows)
+{
+	int flags = SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE;
+	char sql[256];
+	unsigned i;
+
+	memset(t, 0, sizeof *t);
+	snprintf(t->filename, sizeof t->filename, "micro-%u-%u.db", page_size,
+		 n_rows);
+	t->page_size = page_size;
+	t->n_rows = n_rows;
+
+	/* Leave room for the cell header, so each row takes a page. */
+	t->blob_size = (int)(page_size * 3 / 4);
+	t->blob = mustMalloc((size_t)t->blob_size);
+	memset(t->blob, 0xab, (size_t)t->blob_size);
+
+	check(sqlite3_open_v2(t->filename, &t->db, flags, VFS_NAME),
+	      "sqlite3_open_v2");
+	snprintf(sql, sizeof sql, "PRAGMA page_size=%u", page_size);
+	mustExec(t->db, sql);
+	mustExec(t->db, "PRAGMA synchronous=OFF");
+	mustExec(t->db, "PRAGMA journal_mode=WAL");
+	mustExec(t->db, "PRAGMA wal_autocheckpoint=0");
+	mustExec(t->db, "PRAGMA cache_spill=OFF");
+
+	txExec(t, "CREATE TABLE t(k INTEGER PRIMARY KEY, v BLOB)");
+	snprintf(sql, sizeof sql,
+		 "WITH RECURSIVE s(k) AS (SELECT 0 UNION ALL SELECT k + 1 "
+		 "FROM s WHERE k + 1 < %u) "
+		 "INSERT INTO t SELECT k, zeroblob(%d) FROM s",
+		 2 * n_rows, t->blob_size);
+	txExec(t, sql);
+
+	check(sqlite3_prepare_v2(t->db,
+				 "UPDATE t SET v = ? WHERE k >= ? AND k < ?",
+				 -1, &t->update, NULL),
+	      "prepare");
+
+	/* Warm up the buffers. */
+	for (i = 0; i < 2; i++) {
+		txWrite(t);
+		txPoll(t);
+		txDecode(t);
+		txApply(t);
+		txMaybeCheckpoint(t);
+	}
+}
+
+static void txClose(struct tx *t)
+{
+	sqlite3_finalize(t->update);
+	sqlite3_close(t->db);
+	free(t->blob);
+	free(t->page_numbers);
+	free(t->pages);
+	free(t->numbers);
+}
+
+static void vfsPollOp(void *arg, struct sample *s)
+{
+	struct tx *t = arg;
+	uint64_t start;
+
+	txWrite(t);
+	start = now();
+	txPoll(t);
+	s->ns += now() - start;
+	txDecode(t);
+	txApply(t);
+	txMaybeCheckpoint(t);
+
+	s->ops++;
+	s->bytes += (uint64_t)t->n * t->page_size;
+}
+
+static void vfsApplyOp(void *arg, struct sample *s)
+{
+	struct tx *t = arg;
+	uint64_t start;
+
+	txWrite(t);
+	txPoll(t);
+	txDecode(t);
+	start = now();
+	txApply(t);
+	s->ns += now() - start;
+	txMaybeCheckpoint(t);
+
+	s->ops++;
+	s->bytes += (uint64_t)t->n * t->page_size;
+}
+
+static void benchVfs(void)
+{
+	char params[128];
+	struct tx t;
+	unsigned i;
+	unsigned j;
+
+	for (i = 0; i < ARRAY_SIZE(page_sizes); i++) {
+		for (j = 0; j < ARRAY_SIZE(tx_pages); j++) {
+			txOpen(&t, page_sizes[i], tx_pages[j]);
+			snprintf(params, sizeof params,
+				 "\"page_size\": %u, \"tx_pages\": %u",
+				 page_sizes[i], tx_pages[j]);
+			measure("vfs_poll", params, vfsPollOp, &t);
+			measure("vfs_apply", params, vfsApplyOp, &t);
+			txClose(&t);
+		}
+	}
+}
+
+struct snapshot
+{
+	const char *filename;
+	void *data;
+	size_t n;
+};
+
+static void snapshotOp(void *arg, struct sample *s)
+{
+	struct snapshot *snap = arg;
+	void *data;
+	size_t n;
+	uint64_t start;
+
+	start = now();
+	check(VfsSnapshot(&vfs, snap->filename, &data, &n), "VfsSnapshot");
+	raft_free(data);
+	s->ns += now() - start;
+
+	s->ops++;
+	s->bytes += n;
+}
+
+static void restoreOp(void *arg, struct sample *s)
+{
+	struct snapshot *snap = arg;
+	uint64_t start;
+
+	start = now();
+	check(VfsRestore(&vfs, snap->filename, snap->data, snap->n),
+	      "VfsRestore");
+	s->ns += now() - start;
+
+	s->ops++;
+	s->bytes += snap->n;
+}
+
+static void benchSnapshot(void)
+{
+	char params[128];
+	struct snapshot snap;
+	struct tx t;
+	uint32_t n_pages;
+	int log;
+	int ckpt;
+	unsigned i;
+
+	for (i = 0; i < ARRAY_SIZE(page_sizes); i++) {
+		/* Each row takes a page, so half of the rows get 1024
+		 * pages. */
+		txOpen(&t, page_sizes[i], SNAPSHOT_PAGES / 2);
+		check(sqlite3_wal_checkpoint_v2(t.db, "main",
+						SQLITE_CHECKPOINT_TRUNCATE,
+						&log, &ckpt),
+		      "checkpoint");
+		check(VfsDatabaseNumPages(&vfs, t.filename, &n_pages),
+		      "VfsDatabaseNumPages");
+		snap.filename = t.filename;
+		check(VfsSnapshot(&vfs, snap.filename, &snap.data, &snap.n),
+		      "VfsSnapshot");
+
+		snprintf(params, sizeof params,
+			 "\"page_size\": %u, \"pages\": %u", page_sizes[i],
+			 n_pages);
+		measure("vfs_snapshot", params, snapshotOp, &snap);
+
+		/* Restoring a database requires no open connection. */
+		sqlite3_finalize(t.update);
+		t.update = NULL;
+		sqlite3_close(t.db);
+		t.db = NULL;
+		measure("vfs_restore", params, restoreOp, &snap);
+
+		raft_free(snap.data);
+		txClose(&t);
+	}
+}
+
+/* A batch of rows to encode, along with the buffer holding them encoded. */
+struct rows
+{
+	unsigned n_columns;
+	struct value *values; /* TUPLE_BATCH * n_columns values */
+	struct buffer buffer;
+	size_t size;          /* Size of the encoded rows */
+};
+
+static char blob[16] = "0123456789abcdef";
+
+/* Fill a value cycling through integers, floats, texts, blobs and nulls. */
+static void fillValue(struct value *value, unsigned i)
+{
+	switch (i % 5) {
+		case 0:
+			value->type = SQLITE_INTEGER;
+			value->integer = (int64_t)i * 1000003;
+			break;
+		case 1:
+			value->type = SQLITE_FLOAT;
+			value->float_ = (double)i / 3;
+			break;
+		case 2:
+			value->type = SQLITE_TEXT;
+			value->text = "hello world";
+			break;
+		case 3:
+			value->type = SQLITE_BLOB;
+			value->blob.base = blob;
+			value->blob.len = sizeof blob;
+			break;
+		default:
+			value->type = SQLITE_NULL;
+			value->null = 0;
+			break;
+	}
+}
+
+static void encodeRows(struct rows *r)
+{
+	struct tuple_encoder e;
+	unsigned i;
+	unsigned j;
+
+	buffer__reset(&r->buffer);
+	for (i = 0; i < TUPLE_BATCH; i++) {
+		check(tuple_encoder__init(&e, r->n_columns, TUPLE__ROW,
+					  &r->buffer),
+		      "tuple_encoder__init");
+		for (j = 0; j < r->n_columns; j++) {
+			check(tuple_encoder__next(
+				  &e, &r->values[i * r->n_columns + j]),
+			      "tuple_encoder__next");
+		}
+	}
+	r->size = buffer__offset(&r->buffer);
+}
+
+static void tupleEncodeOp(void *arg, struct sample *s)
+{
+	struct rows *r = arg;
+	uint64_t start;
+
+	start = now();
+	encodeRows(r);
+	s->ns += now() - start;
+
+	s->ops += TUPLE_BATCH;
+	s->bytes += r->size;
+}
+
+static void tupleDecodeOp(void *arg, struct sample *s)
+{
+	struct rows *r = arg;
+	struct tuple_decoder d;
+	struct cursor cursor;
+	struct value value;
+	uint64_t start;
+	unsigned i;
+	unsigned j;
+
+	start = now();
+	cursor.p = buffer__cursor(&r->buffer, 0);
+	cursor.cap = r->size;
+	for (i = 0; i < TUPLE_BATCH; i++) {
+		check(tuple_decoder__init(&d, r->n_columns, TUPLE__ROW,
+					  &cursor),
+		      "tuple_decoder__init");
+		for (j = 0; j < r->n_columns; j++) {
+			check(tuple_decoder__next(&d, &value),
+			      "tuple_decoder__next");
+		}
+	}
+	s->ns += now() - start;
+
+	s->ops += TUPLE_BATCH;
+	s->bytes += r->size;
+}
+
+static void benchTuple(void)
+{
+	char params[64];
+	struct rows r;
+	unsigned i;
+	unsigned j;
+
+	for (i = 0; i < ARRAY_SIZE(columns); i++) {
+		r.n_columns = columns[i];
+		r.values = mustMalloc(sizeof *r.values * TUPLE_BATCH *
+				      r.n_columns);
+		for (j = 0; j < TUPLE_BATCH * r.n_columns; j++) {
+			fillValue(&r.values[j], j);
+		}
+		check(buffer__init(&r.buffer), "buffer__init");
+		encodeRows(&r);
+
+		snprintf(params, sizeof params, "\"columns\": %u",
+			 r.n_columns);
+		measure("tuple_encode", params, tupleEncodeOp, &r);
+		measure("tuple_decode", params, tupleDecodeOp, &r);
+
+		buffer__close(&r.buffer);
+		free(r.values);
+	}
+}
+
+struct frames_command
+{
+	struct command_frames c;
+	dqlite_vfs_frame *frames;
+	struct raft_buffer buf; /* Encoded command */
+};
+
+static void commandEncodeOp(void *arg, struct sample *s)
+{
+	struct frames_command *f = arg;
+	struct raft_buffer buf;
+	uint64_t start;
+
+	start = now();
+	check(command__encode(COMMAND_FRAMES, &f->c, &buf), "command__encode");
+	raft_free(buf.base);
+	s->ns += now() - start;
+
+	s->ops++;
+	s->bytes += buf.len;
+}
+
+static void commandDecodeOp(void *arg, struct sample *s)
+{
+	struct frames_command *f = arg;
+	struct command_frames *c;
+	unsigned long *page_numbers;
+	void *pages;
+	void *command;
+	int type;
+	uint64_t start;
+
+	start = now();
+	check(command__decode(&f->buf, &type, &command), "command__decode");
+	c = command;
+	check(command_frames__page_numbers(c, &page_numbers),
+	      "command_frames__page_numbers");
+	command_frames__pages(c, &pages);
+	sqlite3_free(page_numbers);
+	raft_free(command);
+	s->ns += now() - start;
+
+	s->ops++;
+	s->bytes += f->buf.len;
+}
+
+static void benchCommand(void)
+{
+	const unsigned page_size = 4096;
+	char params[64];
+	struct frames_command f;
+	uint8_t *pages;
+	unsigned i;
+	unsigned j;
+
+	for (i = 0; i < ARRAY_SIZE(tx_pages); i++) {
+		unsigned n = tx_pages[i];
+
+		pages = mustMalloc((size_t)page_size * n);
+		memset(pages, 0xab, (size_t)page_size * n);
+		f.frames = mustMalloc(sizeof *f.frames * n);
+		for (j = 0; j < n; j++) {
+			f.frames[j].page_number = j + 1;
+			f.frames[j].data = pages + (size_t)page_size * j;
+		}
+		memset(&f.c, 0, sizeof f.c);
+		f.c.filename = "micro.db";
+		f.c.tx_id = 1;
+		f.c.is_commit = 1;
+		f.c.frames.n_pages = n;
+		f.c.frames.page_size = (uint16_t)page_size;
+		f.c.frames.data = f.frames;
+		check(command__encode(COMMAND_FRAMES, &f.c, &f.buf),
+		      "command__encode");
+
+		snprintf(params, sizeof params,
+			 "\"page_size\": %u, \"pages\": %u", page_size, n);
+		measure("command_encode", params, commandEncodeOp, &f);
+		measure("command_decode", params, commandDecodeOp, &f);
+
+		raft_free(f.buf.base);
+		free(f.frames);
+		free(pages);
+	}
+}
+
+struct query
+{
+	sqlite3_stmt *stmt;
+	struct buffer buffer;
+};
+
+static void queryOp(void *arg, struct sample *s)
+{
+	struct query *q = arg;
+	uint64_t start;
+	int rv;
+
+	sqlite3_reset(q->stmt);
+	start = now();
+	do {
+		buffer__reset(&q->buffer);
+		rv = query__batch(q->stmt, &q->buffer);
+		s->bytes += buffer__offset(&q->buffer);
+	} while (rv == SQLITE_ROW);
+	s->ns += now() - start;
+	if (rv != SQLITE_DONE) {
+		check(rv, "query__batch");
+	}
+
+	s->ops += QUERY_ROWS;
+}
+
+static void benchQuery(void)
+{
+	static const char *types[] = { "INTEGER", "REAL", "TEXT", "BLOB" };
+	static const char *exprs[] = { "k * 1000003", "k / 3.0",
+				       "'hello world'", "randomblob(16)" };
+	char params[64];
+	struct query q;
+	sqlite3 *db;
+	char *create;
+	char *insert;
+	unsigned i;
+	unsigned j;
+
+	for (i = 0; i < ARRAY_SIZE(columns); i++) {
+		check(sqlite3_open(":memory:", &db), "sqlite3_open");
+
+		create = sqlite3_mprintf("CREATE TABLE t(k INTEGER");
+		insert = sqlite3_mprintf(
+		    "WITH RECURSIVE s(k) AS (SELECT 0 UNION ALL SELECT k + 1 "
+		    "FROM s WHERE k + 1 < %u) INSERT INTO t SELECT k",
+		    QUERY_ROWS);
+		for (j = 1; j < columns[i]; j++) {
+			create = sqlite3_mprintf("%z, c%u %s", create, j,
+						 types[j % 4]);
+			insert = sqlite3_mprintf("%z, %s", insert,
+						 exprs[j % 4]);
+		}
+		create = sqlite3_mprintf("%z)", create);
+		insert = sqlite3_mprintf("%z FROM s", insert);
+		mustExec(db, create);
+		mustExec(db, insert);
+		sqlite3_free(create);
+		sqlite3_free(insert);
+
+		check(sqlite3_prepare_v2(db, "SELECT * FROM t", -1, &q.stmt,
+					 NULL),
+		      "prepare");
+		check(buffer__init(&q.buffer), "buffer__init");
+
+		snprintf(params, sizeof params, "\"columns\": %u", columns[i]);
+		measure("query_batch", params, queryOp, &q);
+
+		buffer__close(&q.buffer);
+		sqlite3_finalize(q.stmt);
+		sqlite3_close(db);
+	}
+}
+
+struct group
+{
+	const char *name;
+	void (*run)(void);
+};
+
+static const struct group groups[] = {
+	{ "vfs", benchVfs },	     { "snapshot", benchSnapshot },
+	{ "tuple", benchTuple },     { "command", benchCommand },
+	{ "query", benchQuery },
+};
+
+static void usage(void)
+{
+	fprintf(stderr,
+		"usage: micro-bench [-t SECONDS] [-r RUNS] "
+		"[vfs|snapshot|tuple|command|query...]\n");
+	exit(2);
+}
+
+int main(int argc, char *argv[])
+{
+	bool selected[ARRAY_SIZE(groups)] = { false };
+	bool any = false;
+	double seconds = 0.2;
+	unsigned i;
+	int opt;
+	int j;
+
+	options.runs = 3;
+	while ((opt = getopt(argc, argv, "t:r:")) != -1) {
+		switch (opt) {
+			case 't':
+				seconds = atof(optarg);
+				break;
+			case 'r':
+				options.runs = (unsigned)atoi(optarg);
+				break;
+			default:
+				usage();
+		}
+	}
+	if (seconds <= 0 || options.runs == 0) {
+		usage();
+	}
+	options.min_ns = (uint64_t)(seconds * 1e9);
+
+	for (j = optind; j < argc; j++) {
+		for (i = 0; i < ARRAY_SIZE(groups); i++) {
+			if (strcmp(argv[j], groups[i].name) == 0) {
+				selected[i] = true;
+				any = true;
+				break;
+			}
+		}
+		if (i == ARRAY_SIZE(groups)) {
+			usage();
+		}
+	}
+
+	check(sqlite3_initialize(), "sqlite3_initialize");
+	check(VfsInit(&vfs, VFS_NAME), "VfsInit");
+	check(sqlite3_vfs_register(&vfs, 0), "sqlite3_vfs_register");
+
+	printf("[\n");
+	for (i = 0; i < ARRAY_SIZE(groups); i++) {
+		if (!any || selected[i]) {
+			groups[i].run();
+		}
+	}
+	printf("%s]\n", first ? "" : "\n");
+
+	VfsClose(&vfs);
+
+	return 0;
+}
@@ -818,6 +818,54 @@ TEST(logAcquire, oom, setUp, tearDown, 0, NULL)
     return MUNIT_OK;
 }
 
+/* Acquire a single entry. */
+TEST(logAcquire, entry, setUp, tearDown, 0, NULL)
+{
+    struct fixture *f = data;
+    struct raft_entry *entry;
+    int rv;
+
+    APPEND(1 /* term */);
+    APPEND(1 /* term */);
+
+    rv = logAcquireEntry(f->log, 2, &entry);
+    munit_assert_int(rv, ==, 0);
+    munit_assert_ptr_not_null(entry);
+    munit_assert_ptr_equal(entry->buf.base, GET(2)->buf.base);
+    ASSERT_REFCOUNT(1 /* index */, 1 /* count */);
+    ASSERT_REFCOUNT(2 /* index */, 2 /* count */);
+
+    logRelease(f->log, 2, entry, 1);
+    ASSERT_REFCOUNT(2 /* index */, 1 /* count */);
+
+    rv = logAcquireEntry(f->log, 3, &entry);
+    munit_assert_int(rv, ==, RAFT_NOTFOUND);
+    munit_assert_ptr_null(entry);
+
+    return MUNIT_OK;
+}
+
+/* An acquired entry keeps its batch alive even if all the entries of the batch
+ * get deleted from the log. */
+TEST(logAcquire, entryInBatch, setUp, tearDown, 0, NULL)
+{
+    struct fixture *f = data;
+    struct raft_entry *entry;
+
+    APPEND_BATCH(3 /* n entries */);
+
+    int rv = logAcquireEntry(f->log, 2, &entry);
+    munit_assert_int(rv, ==, 0);
+
+    SNAPSHOT(3 /* index */, 0 /* trailing */);
+    munit_assert_int(NUM_ENTRIES, ==, 0);
+
+    munit_assert_int(*(uint64_t *)entry->buf.base, ==, 1000);
+    logRelease(f->log, 2, entry, 1);
+
+    return MUNIT_OK;
+}
+
 /******************************************************************************
  *
  * logTruncate
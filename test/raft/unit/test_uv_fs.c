@@ -170,28 +170,28 @@ MunitParameterEnum fallocateParams[] = {
         if (f != NULL) {                                                       \
             fallocate_ = atoi(f);                                              \
         }                                                                      \
-        rv_ =                                                                  \
-            UvFsAllocateFile(DIR, FILENAME, SIZE, &fd_, fallocate_, &errmsg_); \
+        rv_ = UvFsAllocateFile(DIR, FILENAME, SIZE, &fd_, fallocate_, true,    \
+                               &errmsg_);                                      \
         munit_assert_int(rv_, ==, 0);                                          \
         munit_assert_int(UvOsClose(fd_), ==, 0);                               \
     }
 
 /* Assert that creating a file with the given parameters fails with the given
  * code and error message. */
-#define ALLOCATE_FILE_ERROR(DIR, FILENAME, SIZE, RV, ERRMSG)                  \
-    {                                                                         \
-        uv_file fd_;                                                          \
-        char errmsg_[RAFT_ERRMSG_BUF_SIZE];                                   \
-        int rv_;                                                              \
-        bool fallocate_ = true;                                               \
-        const char *f = munit_parameters_get(params, FALLOCATE_PARAM);        \
-        if (f != NULL) {                                                      \
-            fallocate_ = atoi(f);                                             \
-        }                                                                     \
-        rv_ =                                                                 \
-            UvFsAllocateFile(DIR, FILENAME, SIZE, &fd_, fallocate_, errmsg_); \
-        munit_assert_int(rv_, ==, RV);                                        \
-        munit_assert_string_equal(errmsg_, ERRMSG);                           \
+#define ALLOCATE_FILE_ERROR(DIR, FILENAME, SIZE, RV, ERRMSG)                   \
+    {                                                                          \
+        uv_file fd_;                                                           \
+        char errmsg_[RAFT_ERRMSG_BUF_SIZE];                                    \
+        int rv_;                                                               \
+        bool fallocate_ = true;                                                \
+        const char *f = munit_parameters_get(params, FALLOCATE_PARAM);         \
+        if (f != NULL) {                                                       \
+            fallocate_ = atoi(f);                                              \
+        }                                                                      \
+        rv_ = UvFsAllocateFile(DIR, FILENAME, SIZE, &fd_, fallocate_, true,    \
+                               errmsg_);                                       \
+        munit_assert_int(rv_, ==, RV);                                         \
+        munit_assert_string_equal(errmsg_, ERRMSG);                            \
     }
 
 SUITE(UvFsAllocateFile)
@@ -268,21 +268,24 @@ TEST(UvFsAllocateFile, noSpace, DirSetUp, DirTearDown, 0, noSpaceParams)
  *****************************************************************************/
 
 /* Invoke UvFsProbeCapabilities against the given dir and assert that it returns
- * the given values for direct I/O and async I/O. */
+ * the given values for direct I/O and async I/O. io_uring is never selected
+ * when KAIO is fully asynchronous. */
 #define PROBE_CAPABILITIES(DIR, DIRECT_IO, ASYNC_IO, FALLOCATE)                \
     {                                                                          \
         size_t direct_io_;                                                     \
         bool async_io_;                                                        \
+        bool uring_io_;                                                        \
         bool fallocate_;                                                       \
         char errmsg_[RAFT_ERRMSG_BUF_SIZE];                                    \
         int rv_;                                                               \
-        rv_ = UvFsProbeCapabilities(DIR, &direct_io_, &async_io_, &fallocate_, \
-                                    errmsg_);                                  \
+        rv_ = UvFsProbeCapabilities(DIR, &direct_io_, &async_io_,              \
+                                    &uring_io_, &fallocate_, errmsg_);         \
         munit_assert_int(rv_, ==, 0);                                          \
         munit_assert_size(direct_io_, ==, DIRECT_IO);                          \
         munit_assert_int(fallocate_, ==, FALLOCATE);                           \
         if (ASYNC_IO) {                                                        \
             munit_assert_true(async_io_);                                      \
+            munit_assert_false(uring_io_);                                     \
         } else {                                                               \
             munit_assert_false(async_io_);                                     \
         }                                                                      \
@@ -293,11 +296,12 @@ TEST(UvFsAllocateFile, noSpace, DirSetUp, DirTearDown, 0, noSpaceParams)
     {                                                                          \
         size_t direct_io_;                                                     \
         bool async_io_;                                                        \
+        bool uring_io_;                                                        \
         bool fallocate_;                                                       \
         char errmsg_[RAFT_ERRMSG_BUF_SIZE];                                    \
         int rv_;                                                               \
-        rv_ = UvFsProbeCapabilities(DIR, &direct_io_, &async_io_, &fallocate_, \
-                                    errmsg_);                                  \
+        rv_ = UvFsProbeCapabilities(DIR, &direct_io_, &async_io_,              \
+                                    &uring_io_, &fallocate_, errmsg_);         \
         munit_assert_int(rv_, ==, RV);                                         \
         munit_assert_string_equal(errmsg_, ERRMSG);                            \
     }
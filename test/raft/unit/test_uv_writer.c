@@ -20,6 +20,7 @@ struct fixture
     size_t direct_io;
     bool fallocate;
     bool async_io;
+    bool uring_io;
     char errmsg[256];
     struct UvWriter writer;
     bool closed;
@@ -50,12 +51,12 @@ static void submitCbAssertResult(struct UvWriterReq *req, int status)
     result->done = true;
 }
 
-/* Initialize the fixture's writer. */
+/* Initialize the fixture's writer, using KAIO. */
 #define INIT(MAX_WRITES)                                                   \
     do {                                                                   \
         int _rv;                                                           \
         _rv = UvWriterInit(&f->writer, &f->loop, f->fd, f->direct_io != 0, \
-                           f->async_io, MAX_WRITES, f->errmsg);            \
+                           f->async_io, false, MAX_WRITES, f->errmsg);     \
         munit_assert_int(_rv, ==, 0);                                      \
         f->writer.data = f;                                                \
         f->closed = false;                                                 \
@@ -67,7 +68,7 @@ static void submitCbAssertResult(struct UvWriterReq *req, int status)
     do {                                                                   \
         int _rv;                                                           \
         _rv = UvWriterInit(&f->writer, &f->loop, f->fd, f->direct_io != 0, \
-                           f->async_io, 1, f->errmsg);                     \
+                           f->async_io, false, 1, f->errmsg);              \
         munit_assert_int(_rv, ==, RV);                                     \
         munit_assert_string_equal(f->errmsg, ERRMSG);                      \
     } while (0)
@@ -193,7 +194,7 @@ static void *setUpDeps(const MunitParameter params[], void *user_data)
     SET_UP_DIR;
     SETUP_LOOP;
     rv = UvFsProbeCapabilities(f->dir, &f->direct_io, &f->async_io,
-                               &f->fallocate, errmsg);
+                               &f->uring_io, &f->fallocate, errmsg);
     munit_assert_int(rv, ==, 0);
     f->block_size = f->direct_io != 0 ? f->direct_io : 4096;
     rv = UvOsJoin(f->dir, "foo", path);
@@ -227,6 +228,25 @@ static void *setUp(const MunitParameter params[], void *user_data)
     return f;
 }
 
+/* Set up a writer using io_uring, skipping if the kernel doesn't support it. */
+static void *setUpUring(const MunitParameter params[], void *user_data)
+{
+    struct fixture *f = setUpDeps(params, user_data);
+    int rv;
+    if (f == NULL) {
+        return NULL;
+    }
+    rv = UvWriterInit(&f->writer, &f->loop, f->fd, f->direct_io != 0, false,
+                      true, 1, f->errmsg);
+    if (rv != 0) {
+        tearDownDeps(f);
+        return NULL;
+    }
+    f->writer.data = f;
+    f->closed = false;
+    return f;
+}
+
 static void tearDown(void *data)
 {
     struct fixture *f = data;
@@ -364,6 +384,47 @@ TEST(UvWriterSubmit, noResources, setUpDeps, tearDown, 0, DirNoAioParams)
     return MUNIT_OK;
 }
 
+/* Write with io_uring, reusing the same registered buffer. */
+TEST(UvWriterSubmit, uring, setUpUring, tearDown, 0, DirAllParams)
+{
+    struct fixture *f = data;
+    struct uv_buf_t *bufs;
+    struct UvWriterReq req;
+    struct result result = {0, false};
+    int rv;
+    SKIP_IF_NO_FIXTURE;
+    MAKE_BUFS(bufs, 1, 1);
+    req.data = &result;
+    rv = UvWriterSubmit(&f->writer, &req, bufs, 1, 0, submitCbAssertResult);
+    munit_assert_int(rv, ==, 0);
+    LOOP_RUN_UNTIL(&result.done);
+    memset(bufs[0].base, 2, bufs[0].len);
+    result.done = false;
+    rv = UvWriterSubmit(&f->writer, &req, bufs, 1, f->block_size,
+                        submitCbAssertResult);
+    munit_assert_int(rv, ==, 0);
+    LOOP_RUN_UNTIL(&result.done);
+    DESTROY_BUFS(bufs, 1);
+    ASSERT_CONTENT(2);
+    return MUNIT_OK;
+}
+
+/* Write a vector of buffers with io_uring, followed by writes of new buffers
+ * that need to be registered again. */
+TEST(UvWriterSubmit, uringVec, setUpUring, tearDown, 0, DirAllParams)
+{
+    struct fixture *f = data;
+    int i;
+    SKIP_IF_NO_FIXTURE;
+    WRITE(2 /* n bufs */, 1 /* content */, 0 /* offset */);
+    for (i = 2; i < N_BLOCKS; i++) {
+        WRITE(1 /* n bufs */, i + 1 /* content */,
+              i * f->block_size /* offset */);
+    }
+    ASSERT_CONTENT(N_BLOCKS);
+    return MUNIT_OK;
+}
+
 /******************************************************************************
  *
  * UvWriterSubmit
@@ -389,3 +450,12 @@ TEST(UvWriterClose, aio, setUp, tearDownDeps, 0, DirAioParams)
     WRITE_CLOSE(1, 0, 0, RAFT_CANCELED);
     return MUNIT_OK;
 }
+
+/* Close with an inflight io_uring write. */
+TEST(UvWriterClose, uring, setUpUring, tearDownDeps, 0, DirAllParams)
+{
+    struct fixture *f = data;
+    SKIP_IF_NO_FIXTURE;
+    WRITE_CLOSE(1, 0, 0, RAFT_CANCELED);
+    return MUNIT_OK;
+}
@@ -0,0 +1,146 @@
+#include "../../src/checkpoint.h"
+#include "../lib/runner.h"
+
+SUITE(checkpoint);
+
+#define SECOND ((uint64_t)1000 * 1000 * 1000)
+
+/* Configuration with a soft threshold of 1000 frames of 4096 bytes and a hard
+ * bound of 10000 frames. */
+static struct config makeConfig(void)
+{
+	struct config config;
+	config.page_size = 4096;
+	config.checkpoint_threshold = 1000;
+	config.checkpoint_max_wal_size = 10000 * (4096 + 24);
+	config.checkpoint_latency = 10000;
+	return config;
+}
+
+/* The WAL is checkpointed once it reaches the threshold. */
+TEST(checkpoint, threshold, NULL, NULL, 0, NULL)
+{
+	struct config config = makeConfig();
+	struct checkpoint_sched s;
+	int decision;
+
+	checkpoint_sched__init(&s);
+
+	decision = checkpoint_sched__decide(&s, &config, 999, SECOND);
+	munit_assert_int(decision, ==, CHECKPOINT_SKIP);
+	munit_assert_uint(s.target, ==, 1000);
+
+	decision = checkpoint_sched__decide(&s, &config, 1000, 2 * SECOND);
+	munit_assert_int(decision, ==, CHECKPOINT_SOFT);
+
+	return MUNIT_OK;
+}
+
+/* After a deferred attempt the scheduler waits for the WAL to grow by a step
+ * that doubles every time, and starts over once the WAL shrinks. */
+TEST(checkpoint, backoff, NULL, NULL, 0, NULL)
+{
+	struct config config = makeConfig();
+	struct checkpoint_sched s;
+	int decision;
+
+	checkpoint_sched__init(&s);
+
+	decision = checkpoint_sched__decide(&s, &config, 1000, SECOND);
+	munit_assert_int(decision, ==, CHECKPOINT_SOFT);
+	checkpoint_sched__deferred(&s, 1000);
+	munit_assert_uint(s.retry, ==, 1250);
+
+	decision = checkpoint_sched__decide(&s, &config, 1249, 2 * SECOND);
+	munit_assert_int(decision, ==, CHECKPOINT_BACKOFF);
+
+	decision = checkpoint_sched__decide(&s, &config, 1250, 3 * SECOND);
+	munit_assert_int(decision, ==, CHECKPOINT_SOFT);
+	checkpoint_sched__deferred(&s, 1250);
+	munit_assert_uint(s.retry, ==, 1750);
+
+	decision = checkpoint_sched__decide(&s, &config, 10, 4 * SECOND);
+	munit_assert_int(decision, ==, CHECKPOINT_SKIP);
+	munit_assert_uint(s.retry, ==, 0);
+	munit_assert_uint(s.step, ==, 0);
+
+	return MUNIT_OK;
+}
+
+/* The hard bound is always enforced, even while backing off. */
+TEST(checkpoint, hard, NULL, NULL, 0, NULL)
+{
+	struct config config = makeConfig();
+	struct checkpoint_sched s;
+	int decision;
+
+	checkpoint_sched__init(&s);
+
+	decision = checkpoint_sched__decide(&s, &config, 9000, SECOND);
+	munit_assert_int(decision, ==, CHECKPOINT_SOFT);
+	checkpoint_sched__deferred(&s, 9000);
+
+	decision = checkpoint_sched__decide(&s, &config, 10000, 100 * SECOND);
+	munit_assert_int(decision, ==, CHECKPOINT_HARD);
+
+	return MUNIT_OK;
+}
+
+/* A fast growing WAL cuts the backoff short if it's about to reach the hard
+ * bound. */
+TEST(checkpoint, growth, NULL, NULL, 0, NULL)
+{
+	struct config config = makeConfig();
+	struct checkpoint_sched s;
+	int decision;
+
+	checkpoint_sched__init(&s);
+
+	decision = checkpoint_sched__decide(&s, &config, 1000, SECOND);
+	munit_assert_int(decision, ==, CHECKPOINT_SOFT);
+	checkpoint_sched__deferred(&s, 1000);
+
+	/* 100 frames per second: plenty of time left. */
+	decision = checkpoint_sched__decide(&s, &config, 1100, 2 * SECOND);
+	munit_assert_int(decision, ==, CHECKPOINT_BACKOFF);
+
+	/* 100 frames in a millisecond. */
+	decision = checkpoint_sched__decide(&s, &config, 1200,
+					    2 * SECOND + 1000 * 1000);
+	munit_assert_uint64(s.growth, >, 8800);
+	munit_assert_int(decision, ==, CHECKPOINT_SOFT);
+
+	return MUNIT_OK;
+}
+
+/* Expensive checkpoints lower the soft target, down to a fraction of the
+ * threshold. */
+TEST(checkpoint, cost, NULL, NULL, 0, NULL)
+{
+	struct config config = makeConfig();
+	struct checkpoint_sched s;
+	int decision;
+
+	checkpoint_sched__init(&s);
+
+	/* 20 usecs per frame: 500 frames fit in 10 msecs. */
+	checkpoint_sched__done(&s, 1000, 20 * 1000 * 1000);
+	decision = checkpoint_sched__decide(&s, &config, 500, SECOND);
+	munit_assert_uint(s.target, ==, 500);
+	munit_assert_int(decision, ==, CHECKPOINT_SOFT);
+
+	/* Very slow checkpoints. */
+	checkpoint_sched__init(&s);
+	checkpoint_sched__done(&s, 10, SECOND);
+	decision = checkpoint_sched__decide(&s, &config, 100, SECOND);
+	munit_assert_uint(s.target, ==, 125);
+	munit_assert_int(decision, ==, CHECKPOINT_SKIP);
+
+	/* Cheap checkpoints don't raise the target above the threshold. */
+	checkpoint_sched__init(&s);
+	checkpoint_sched__done(&s, 1000, 1000);
+	checkpoint_sched__decide(&s, &config, 100, SECOND);
+	munit_assert_uint(s.target, ==, 1000);
+
+	return MUNIT_OK;
+}
@@ -0,0 +1,107 @@
+#include "../../src/checksum.h"
+#include "../../src/lib/byte.h"
+#include "../lib/runner.h"
+
+SUITE(checksum);
+
+/* Reference implementation, straight from the SQLite file format docs. */
+static void referenceChecksum(bool big_endian,
+			      const uint8_t *data,
+			      size_t n,
+			      uint32_t sums[2])
+{
+	size_t i;
+	for (i = 0; i < n; i += 8) {
+		uint32_t x0 = big_endian ? ByteGetBe32(data + i)
+					 : ByteGetLe32(data + i);
+		uint32_t x1 = big_endian ? ByteGetBe32(data + i + 4)
+					 : ByteGetLe32(data + i + 4);
+		sums[0] += x0 + sums[1];
+		sums[1] += x1 + sums[0];
+	}
+}
+
+static bool hostIsBigEndian(void)
+{
+	int x = 1;
+	return *(char *)(&x) == 0;
+}
+
+/* Checksum n random bytes starting at the given offset of a buffer using all
+ * the supported implementations, and compare them with the reference. */
+static void checkAllImpls(size_t offset, size_t n, bool native)
+{
+	uint8_t *buf = munit_malloc(offset + n);
+	bool big_endian = native == hostIsBigEndian();
+	uint32_t seed[2] = {munit_rand_uint32(), munit_rand_uint32()};
+	uint32_t expected[2] = {seed[0], seed[1]};
+	enum checksum_impl impl;
+
+	munit_rand_memory(offset + n, buf);
+	referenceChecksum(big_endian, buf + offset, n, expected);
+
+	for (impl = 0; impl < CHECKSUM_N_IMPL; impl++) {
+		uint32_t sums[2] = {seed[0], seed[1]};
+		if (!ChecksumImplSupported(impl)) {
+			continue;
+		}
+		ChecksumWalWith(impl, native, buf + offset, n, sums);
+		munit_assert_uint32(sums[0], ==, expected[0]);
+		munit_assert_uint32(sums[1], ==, expected[1]);
+	}
+
+	free(buf);
+}
+
+/* All implementations agree with the reference for every page size, both with
+ * native and non-native byte order. */
+TEST(checksum, pageSizes, NULL, NULL, 0, NULL)
+{
+	size_t page_size;
+	for (page_size = 512; page_size <= 65536; page_size *= 2) {
+		checkAllImpls(0, page_size, true);
+		checkAllImpls(0, page_size, false);
+	}
+	return MUNIT_OK;
+}
+
+/* Short inputs and lengths that aren't a multiple of the vector width. */
+TEST(checksum, oddSizes, NULL, NULL, 0, NULL)
+{
+	size_t n;
+	for (n = 8; n <= 1024; n += 8) {
+		checkAllImpls(0, n, true);
+		checkAllImpls(0, n, false);
+	}
+	return MUNIT_OK;
+}
+
+/* The input doesn't need to be aligned. */
+TEST(checksum, unaligned, NULL, NULL, 0, NULL)
+{
+	size_t offset;
+	for (offset = 1; offset < 32; offset++) {
+		checkAllImpls(offset, 4096, true);
+		checkAllImpls(offset, 24, true);
+	}
+	return MUNIT_OK;
+}
+
+/* Checksumming in chunks is the same as checksumming all at once, which is
+ * how frame headers and pages get chained. */
+TEST(checksum, chained, NULL, NULL, 0, NULL)
+{
+	uint8_t buf[8 + 4096];
+	uint32_t whole[2] = {0, 0};
+	uint32_t chunks[2] = {0, 0};
+
+	munit_rand_memory(sizeof buf, buf);
+	referenceChecksum(hostIsBigEndian(), buf, sizeof buf, whole);
+	ChecksumWal(true, buf, 8, chunks);
+	ChecksumWal(true, buf + 8, 4096, chunks);
+
+	munit_assert_uint32(chunks[0], ==, whole[0]);
+	munit_assert_uint32(chunks[1], ==, whole[1]);
+
+	return MUNIT_OK;
+}
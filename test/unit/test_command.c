@@ -1,6 +1,7 @@
 #include <sqlite3.h>
 
 #include "../../src/command.h"
+#include "../../src/lib/byte.h"
 
 #include "../lib/runner.h"
 
@@ -49,3 +50,63 @@ TEST_CASE(open, decode, NULL)
 	raft_free(buf.base);
 	return MUNIT_OK;
 }
+
+/******************************************************************************
+ *
+ * Frames.
+ *
+ ******************************************************************************/
+
+TEST_SUITE(frames);
+
+/* Filling the page numbers and pages in place produces the same buffer as
+ * encoding a list of frames. */
+TEST_CASE(frames, encode_in_place, NULL)
+{
+	struct command_frames c;
+	dqlite_vfs_frame list[3];
+	struct raft_buffer buf1;
+	struct raft_buffer buf2;
+	uint8_t pages_data[3][512];
+	void *page_numbers;
+	void *pages;
+	unsigned i;
+	int rc;
+	(void)data;
+	(void)params;
+
+	for (i = 0; i < 3; i++) {
+		munit_rand_memory(sizeof pages_data[i], pages_data[i]);
+		list[i].page_number = i + 1;
+		list[i].data = pages_data[i];
+	}
+
+	c.filename = "test.db";
+	c.tx_id = 0;
+	c.truncate = 0;
+	c.is_commit = 1;
+	c.__unused1__ = 0;
+	c.__unused2__ = 0;
+	c.frames.n_pages = 3;
+	c.frames.page_size = 512;
+	c.frames.__unused__ = 0;
+	c.frames.data = list;
+
+	rc = command__encode(COMMAND_FRAMES, &c, &buf1);
+	munit_assert_int(rc, ==, 0);
+
+	rc = command_frames__encode_in_place(&c, &buf2, &page_numbers, &pages);
+	munit_assert_int(rc, ==, 0);
+	munit_assert_size(buf2.len, ==, buf1.len);
+	munit_assert_size((uintptr_t)pages % 8, ==, 0);
+	for (i = 0; i < 3; i++) {
+		uint64_t pgno = ByteFlipLe64(list[i].page_number);
+		memcpy((uint8_t *)page_numbers + i * 8, &pgno, 8);
+		memcpy((uint8_t *)pages + i * 512, pages_data[i], 512);
+	}
+	munit_assert_memory_equal(buf1.len, buf2.base, buf1.base);
+
+	raft_free(buf1.base);
+	raft_free(buf2.base);
+	return MUNIT_OK;
+}
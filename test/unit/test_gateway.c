@@ -2291,6 +2291,117 @@ TEST_CASE(request_cluster, unrecognizedFormat, NULL)
 	return MUNIT_OK;
 }
 
+/******************************************************************************
+ *
+ * metrics
+ *
+ ******************************************************************************/
+
+struct metrics_fixture {
+	FIXTURE;
+	struct request_metrics request;
+	struct response_metrics response;
+};
+
+TEST_SUITE(metrics);
+TEST_SETUP(metrics)
+{
+	struct metrics_fixture *f = munit_malloc(sizeof *f);
+	SETUP;
+	CLUSTER_ELECT(0);
+	OPEN;
+	return f;
+}
+TEST_TEAR_DOWN(metrics)
+{
+	struct metrics_fixture *f = data;
+	TEAR_DOWN;
+	free(f);
+}
+
+/* Look up the metric with the given name in the response, which must be
+ * present. */
+static uint64_t lookupMetric(struct metrics_fixture *f, const char *name)
+{
+	struct cursor cursor = *f->cursor;
+	const char *metric;
+	uint64_t value;
+	uint64_t i;
+	int rc;
+
+	for (i = 0; i < f->response.n; i++) {
+		rc = text__decode(&cursor, &metric);
+		munit_assert_int(rc, ==, 0);
+		rc = uint64__decode(&cursor, &value);
+		munit_assert_int(rc, ==, 0);
+		if (strcmp(metric, name) == 0) {
+			return value;
+		}
+	}
+	munit_errorf("metric %s not found", name);
+	return 0;
+}
+
+/* Requests, commits and WAL frames are accounted for. */
+TEST_CASE(metrics, exec, NULL)
+{
+	struct metrics_fixture *f = data;
+	(void)params;
+	EXEC("CREATE TABLE test (n INT)");
+	f->request.format = DQLITE_REQUEST_METRICS_FORMAT_V0;
+	ENCODE(&f->request, metrics);
+	HANDLE(METRICS);
+	ASSERT_CALLBACK(0, METRICS);
+	DECODE(&f->response, metrics);
+	munit_assert_uint64(lookupMetric(f, "requests"), ==, 4);
+	munit_assert_uint64(lookupMetric(f, "request.open.latency_us.count"),
+			    ==, 1);
+	munit_assert_uint64(lookupMetric(f, "request.exec.latency_us.count"),
+			    ==, 1);
+	munit_assert_uint64(lookupMetric(f, "request.exec.failures"), ==, 0);
+	munit_assert_uint64(lookupMetric(f, "exec.latency_us.count"), ==, 1);
+	munit_assert_uint64(lookupMetric(f, "raft.commit_latency_us.count"),
+			    ==, 1);
+	munit_assert_uint64(lookupMetric(f, "fsm.apply_latency_us.count"), >=,
+			    1);
+	munit_assert_uint64(lookupMetric(f, "wal.test.frames"), >, 0);
+	return MUNIT_OK;
+}
+
+/* Failed requests are accounted for. */
+TEST_CASE(metrics, failure, NULL)
+{
+	struct metrics_fixture *f = data;
+	struct request_prepare prepare;
+	(void)params;
+	prepare.db_id = 0;
+	prepare.sql = "garbage";
+	ENCODE(&prepare, prepare);
+	HANDLE(PREPARE);
+	WAIT;
+	ASSERT_CALLBACK(0, FAILURE);
+	f->request.format = DQLITE_REQUEST_METRICS_FORMAT_V0;
+	ENCODE(&f->request, metrics);
+	HANDLE(METRICS);
+	ASSERT_CALLBACK(0, METRICS);
+	DECODE(&f->response, metrics);
+	munit_assert_uint64(lookupMetric(f, "request.prepare.failures"), ==, 1);
+	return MUNIT_OK;
+}
+
+/* Submit a metrics request with an invalid format version. */
+TEST_CASE(metrics, unrecognizedFormat, NULL)
+{
+	struct metrics_fixture *f = data;
+	(void)params;
+	f->request.format = 1;
+	ENCODE(&f->request, metrics);
+	HANDLE(METRICS);
+	ASSERT_CALLBACK(0, FAILURE);
+	ASSERT_FAILURE(SQLITE_PROTOCOL, "bad format version");
+	return MUNIT_OK;
+}
+
 /******************************************************************************
  *
  * invalid
@@ -0,0 +1,100 @@
+#include "../../src/metrics.h"
+#include "../lib/runner.h"
+
+SUITE(metrics);
+
+/* Small values get a bucket each, larger ones share buckets whose width
+ * doubles at every power of two. */
+TEST(metrics, buckets, NULL, NULL, 0, NULL)
+{
+	unsigned i;
+
+	for (i = 0; i < 16; i++) {
+		munit_assert_uint(dqlite__histogram_bucket(i), ==, i);
+		munit_assert_uint64(dqlite__histogram_lower(i), ==, i);
+		munit_assert_uint64(dqlite__histogram_upper(i), ==, i);
+	}
+
+	munit_assert_uint(dqlite__histogram_bucket(16), ==, 16);
+	munit_assert_uint(dqlite__histogram_bucket(17), ==, 16);
+	munit_assert_uint(dqlite__histogram_bucket(31), ==, 23);
+	munit_assert_uint(dqlite__histogram_bucket(32), ==, 24);
+	munit_assert_uint64(dqlite__histogram_lower(24), ==, 32);
+	munit_assert_uint64(dqlite__histogram_upper(24), ==, 35);
+
+	/* Every value falls between the bounds of its bucket. */
+	for (i = 0; i < 1000000; i += 7) {
+		unsigned j = dqlite__histogram_bucket(i);
+		munit_assert_uint64(dqlite__histogram_lower(j), <=, i);
+		munit_assert_uint64(dqlite__histogram_upper(j), >=, i);
+	}
+
+	/* Huge values end up in the last bucket. */
+	munit_assert_uint(dqlite__histogram_bucket(UINT64_MAX), ==,
+			  DQLITE__HISTOGRAM_N_BUCKETS - 1);
+	munit_assert_uint64(
+	    dqlite__histogram_upper(DQLITE__HISTOGRAM_N_BUCKETS - 1), ==,
+	    UINT64_MAX);
+
+	return MUNIT_OK;
+}
+
+/* Percentiles are estimated with the upper bound of the bucket they fall in,
+ * without exceeding the largest recorded value. */
+TEST(metrics, percentile, NULL, NULL, 0, NULL)
+{
+	struct dqlite__histogram h;
+	uint64_t i;
+
+	dqlite__histogram_init(&h);
+	munit_assert_uint64(dqlite__histogram_percentile(&h, 500), ==, 0);
+
+	for (i = 1; i <= 100; i++) {
+		dqlite__histogram_record(&h, i * 10);
+	}
+	munit_assert_uint64(h.count, ==, 100);
+	munit_assert_uint64(h.sum, ==, 50500);
+	munit_assert_uint64(h.max, ==, 1000);
+
+	/* The 50th value is 500, in the [480, 511] bucket. */
+	munit_assert_uint64(dqlite__histogram_percentile(&h, 500), ==, 511);
+	/* The 99th value is 990, in the [960, 1023] bucket. */
+	munit_assert_uint64(dqlite__histogram_percentile(&h, 990), ==, 1000);
+	munit_assert_uint64(dqlite__histogram_percentile(&h, 1000), ==, 1000);
+
+	return MUNIT_OK;
+}
+
+static int countMetric(void *arg, const char *name, uint64_t value)
+{
+	unsigned *n = arg;
+	(void)name;
+	(void)value;
+	(*n)++;
+	return 0;
+}
+
+/* Only request types that were served show up. */
+TEST(metrics, visit, NULL, NULL, 0, NULL)
+{
+	struct dqlite__metrics *m = munit_malloc(sizeof *m);
+	unsigned n1 = 0;
+	unsigned n2 = 0;
+	int rv;
+
+	dqlite__metrics_init(m);
+	rv = dqlite__metrics_visit(m, countMetric, &n1);
+	munit_assert_int(rv, ==, 0);
+
+	dqlite__metrics_request(m, 5, false, 3000);
+	rv = dqlite__metrics_visit(m, countMetric, &n2);
+	munit_assert_int(rv, ==, 0);
+
+	/* Failures, count, sum, max, 4 percentiles and one bucket. */
+	munit_assert_uint(n2, ==, n1 + 9);
+	munit_assert_uint64(m->requests, ==, 1);
+	munit_assert_uint64(m->request[5].latency.max, ==, 3);
+
+	free(m);
+	return MUNIT_OK;
+}
@@ -306,6 +306,57 @@ TEST_CASE(exec, checkpoint_read_lock, NULL)
 	return MUNIT_OK;
 }
 
+/* If a read transaction is in progress, the frames it doesn't need are still
+ * copied back, and the WAL gets truncated once the reader is gone. */
+TEST_CASE(exec, checkpoint_passive, NULL)
+{
+	struct exec_fixture *f = data;
+	struct config *config = CLUSTER_CONFIG(0);
+	struct registry *registry = CLUSTER_REGISTRY(0);
+	struct dqlite__metrics *metrics = &registry->metrics;
+	struct db *db;
+	struct leader leader2;
+	char *errmsg;
+	int rv;
+	(void)params;
+	config->checkpoint_threshold = 3;
+
+	CLUSTER_ELECT(0);
+	EXEC_SQL(0, "CREATE TABLE test (n  INT)");
+
+	rv = registry__db_get(registry, "test.db", &db);
+	munit_assert_int(rv, ==, 0);
+	leader__init(&leader2, db, CLUSTER_RAFT(0));
+
+	rv = sqlite3_exec(leader2.conn, "BEGIN", NULL, NULL, &errmsg);
+	munit_assert_int(rv, ==, 0);
+	rv = sqlite3_exec(leader2.conn, "SELECT * FROM test", NULL, NULL,
+			  &errmsg);
+	munit_assert_int(rv, ==, 0);
+
+	EXEC_SQL(0, "INSERT INTO test(n) VALUES(1)");
+
+	/* The frames visible to the reader were copied back, the others were
+	 * deferred. */
+	munit_assert_uint64(metrics->checkpoints, ==, 1);
+	munit_assert_uint64(metrics->checkpoint_frames, >, 0);
+	munit_assert_uint64(
+	    metrics->checkpoint_deferred[DQLITE__CHECKPOINT_READER], ==, 1);
+	munit_assert_uint64(metrics->checkpoint_deferred_frames, >, 0);
+	ASSERT_WAL_PAGES(0, 3);
+
+	rv = sqlite3_exec(leader2.conn, "COMMIT", NULL, NULL, &errmsg);
+	munit_assert_int(rv, ==, 0);
+	leader__close(&leader2);
+
+	EXEC_SQL(0, "INSERT INTO test(n) VALUES(2)");
+	munit_assert_uint64(metrics->checkpoints, ==, 2);
+	munit_assert_uint64(metrics->checkpoint_deferred_frames, ==, 0);
+	ASSERT_WAL_PAGES(0, 0);
+
+	return MUNIT_OK;
+}
+
 /******************************************************************************
  *
  * Fixture
@@ -423,3 +474,45 @@ TEST(replication, checkpoint, setUp, tearDown, 0, NULL)
 
 	return MUNIT_OK;
 }
+
+/* Checkpoints taken by followers are accounted for in the registry metrics,
+ * whether they run on the pool or synchronously. */
+TEST(replication, checkpointFollower, setUp, tearDown, 0, NULL)
+{
+	struct fixture *f = data;
+	struct registry *registry = CLUSTER_REGISTRY(1);
+	struct db *db;
+	unsigned i;
+	int rv;
+
+	for (i = 0; i < N_SERVERS; i++) {
+		f->servers[i].config.checkpoint_threshold = 3;
+	}
+	fsm__set_raft(&f->fsms[1], CLUSTER_RAFT(1));
+
+	CLUSTER_ELECT(0);
+
+	PREPARE(0, "CREATE TABLE test (n  INT)");
+	rv = leader__exec(LEADER(0), &f->req, f->stmt, 0, execCb);
+	munit_assert_int(rv, ==, 0);
+	CLUSTER_APPLIED(4);
+	FINALIZE;
+
+	PREPARE(0, "INSERT INTO test(n) VALUES(1)");
+	rv = leader__exec(LEADER(0), &f->req, f->stmt, 0, execCb);
+	munit_assert_int(rv, ==, 0);
+	CLUSTER_APPLIED(6);
+	FINALIZE;
+
+	db = registry__db_lookup(registry, "test.db");
+	munit_assert_ptr_not_null(db);
+	munit_assert_int(db->checkpoint.state, ==, DB_CHECKPOINT_IDLE);
+	munit_assert_uint64(registry->metrics.checkpoints, ==, 1);
+	munit_assert_uint64(registry->metrics.checkpoint_frames, >=, 3);
+
+	/* The pinned raft entries must be released before closing raft. */
+	rv = VfsReleaseBorrowed(&f->servers[1].vfs);
+	munit_assert_int(rv, ==, 0);
+
+	return MUNIT_OK;
+}
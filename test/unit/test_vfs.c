@@ -12,6 +12,7 @@
 #include "../lib/sqlite.h"
 
 #include "../../src/format.h"
+#include "../../src/lib/byte.h"
 #include "../../src/raft.h"
 #include "../../src/vfs.h"
 
@@ -1477,6 +1478,420 @@ TEST(VfsInit, oom, setUp, tearDown, 0, test_create_oom_params)
 	return MUNIT_OK;
 }
 
+/******************************************************************************
+ *
+ * VfsResidentSize
+ *
+ ******************************************************************************/
+
+SUITE(VfsResidentSize)
+
+/* Pages are allocated in extents, which are released once no page is in use
+ * anymore. */
+TEST(VfsResidentSize, extents, setUp, tearDown, 0, NULL)
+{
+	struct fixture *f = data;
+	sqlite3_file *file = __file_create_main_db(f);
+	void *buf_page_1 = __buf_page_1();
+	void *buf_page_2 = __buf_page_2();
+	uint64_t size;
+	int rc;
+
+	(void)params;
+
+	munit_assert_uint64(VfsResidentSize(&f->vfs), ==, 0);
+
+	/* The first write allocates a whole extent. */
+	rc = file->pMethods->xWrite(file, buf_page_1, 512, 0);
+	munit_assert_int(rc, ==, 0);
+	size = VfsResidentSize(&f->vfs);
+	munit_assert_uint64(size, >=, 2 * 512);
+
+	/* Further pages are carved out of the same extent. */
+	rc = file->pMethods->xWrite(file, buf_page_2, 512, 512);
+	munit_assert_int(rc, ==, 0);
+	munit_assert_uint64(VfsResidentSize(&f->vfs), ==, size);
+
+	/* Releasing a page keeps the extent around for reuse. */
+	rc = file->pMethods->xTruncate(file, 512);
+	munit_assert_int(rc, ==, 0);
+	munit_assert_uint64(VfsResidentSize(&f->vfs), ==, size);
+
+	rc = file->pMethods->xWrite(file, buf_page_2, 512, 512);
+	munit_assert_int(rc, ==, 0);
+	munit_assert_uint64(VfsResidentSize(&f->vfs), ==, size);
+
+	/* Releasing all pages gives the memory back. */
+	rc = file->pMethods->xTruncate(file, 0);
+	munit_assert_int(rc, ==, 0);
+	munit_assert_uint64(VfsResidentSize(&f->vfs), ==, 0);
+
+	free(buf_page_1);
+	free(buf_page_2);
+	rc = file->pMethods->xClose(file);
+	munit_assert_int(rc, ==, 0);
+	free(file);
+
+	return MUNIT_OK;
+}
+
+/* A page which is released and allocated again keeps its content intact once
+ * rewritten. */
+TEST(VfsResidentSize, reuse, setUp, tearDown, 0, NULL)
+{
+	struct fixture *f = data;
+	sqlite3_file *file = __file_create_main_db(f);
+	void *buf_page_1 = __buf_page_1();
+	void *buf_page_2 = __buf_page_2();
+	char buf[512];
+	int rc;
+
+	(void)params;
+
+	rc = file->pMethods->xWrite(file, buf_page_1, 512, 0);
+	munit_assert_int(rc, ==, 0);
+	rc = file->pMethods->xWrite(file, buf_page_2, 512, 512);
+	munit_assert_int(rc, ==, 0);
+	rc = file->pMethods->xTruncate(file, 512);
+	munit_assert_int(rc, ==, 0);
+	rc = file->pMethods->xWrite(file, buf_page_2, 512, 512);
+	munit_assert_int(rc, ==, 0);
+
+	rc = file->pMethods->xRead(file, buf, 512, 0);
+	munit_assert_int(rc, ==, 0);
+	munit_assert_int(memcmp(buf, buf_page_1, 512), ==, 0);
+
+	rc = file->pMethods->xRead(file, buf, 512, 512);
+	munit_assert_int(rc, ==, 0);
+	munit_assert_int(memcmp(buf, buf_page_2, 512), ==, 0);
+
+	free(buf_page_1);
+	free(buf_page_2);
+	rc = file->pMethods->xClose(file);
+	munit_assert_int(rc, ==, 0);
+	free(file);
+
+	return MUNIT_OK;
+}
+
+/* Helper to replicate the last write transaction performed on the "test.db"
+ * database of the given VFS back to the VFS itself. */
+static void __vfs_poll_and_apply(sqlite3_vfs *vfs)
+{
+	dqlite_vfs_frame *frames;
+	unsigned long *page_numbers;
+	uint8_t *pages;
+	unsigned n;
+	unsigned i;
+	int rv;
+
+	rv = VfsPoll(vfs, "test.db", &frames, &n);
+	munit_assert_int(rv, ==, 0);
+	munit_assert_uint(n, >, 0);
+
+	page_numbers = munit_malloc(sizeof *page_numbers * n);
+	pages = munit_malloc(512 * n);
+	for (i = 0; i < n; i++) {
+		page_numbers[i] = frames[i].page_number;
+		memcpy(pages + i * 512, frames[i].data, 512);
+		sqlite3_free(frames[i].data);
+	}
+	sqlite3_free(frames);
+
+	rv = VfsApply(vfs, "test.db", n, page_numbers, pages);
+	munit_assert_int(rv, ==, 0);
+
+	free(page_numbers);
+	free(pages);
+}
+
+/* Frames released by a checkpoint are reused by the next transactions. */
+TEST(VfsResidentSize, framePool, setUp, tearDown, 0, NULL)
+{
+	struct fixture *f = data;
+	sqlite3_stmt *stmt;
+	sqlite3 *db;
+	uint64_t size;
+	int log;
+	int ckpt;
+	int rv;
+
+	(void)params;
+
+	db = __db_open();
+	__db_exec(db, "CREATE TABLE test (n INT)");
+	__vfs_poll_and_apply(&f->vfs);
+
+	rv = sqlite3_wal_checkpoint_v2(db, "main", SQLITE_CHECKPOINT_TRUNCATE,
+				       &log, &ckpt);
+	munit_assert_int(rv, ==, 0);
+	size = VfsResidentSize(&f->vfs);
+	munit_assert_uint64(size, >, 0);
+
+	/* The new frames don't need any new memory. */
+	__db_exec(db, "INSERT INTO test(n) VALUES(1)");
+	__vfs_poll_and_apply(&f->vfs);
+	munit_assert_uint64(VfsResidentSize(&f->vfs), ==, size);
+
+	rv = sqlite3_wal_checkpoint_v2(db, "main", SQLITE_CHECKPOINT_TRUNCATE,
+				       &log, &ckpt);
+	munit_assert_int(rv, ==, 0);
+
+	/* Disabling the pool still works. */
+	VfsSetFramePoolCap(&f->vfs, 0);
+	__db_exec(db, "INSERT INTO test(n) VALUES(2)");
+	__vfs_poll_and_apply(&f->vfs);
+
+	rv = sqlite3_prepare_v2(db, "SELECT count(*) FROM test", -1, &stmt,
+				NULL);
+	munit_assert_int(rv, ==, SQLITE_OK);
+	rv = sqlite3_step(stmt);
+	munit_assert_int(rv, ==, SQLITE_ROW);
+	munit_assert_int(sqlite3_column_int(stmt, 0), ==, 2);
+	sqlite3_finalize(stmt);
+
+	__db_close(db);
+
+	return MUNIT_OK;
+}
+
+/******************************************************************************
+ *
+ * VfsPollInto
+ *
+ ******************************************************************************/
+
+SUITE(VfsPollInto)
+
+/* The frames of a transaction can be copied directly into caller-provided
+ * buffers and applied from there. */
+TEST(VfsPollInto, apply, setUp, tearDown, 0, NULL)
+{
+	struct fixture *f = data;
+	sqlite3_stmt *stmt;
+	sqlite3 *db;
+	unsigned long *page_numbers;
+	uint8_t *pgnos;
+	uint8_t *pages;
+	unsigned n;
+	unsigned m;
+	unsigned i;
+	int rv;
+
+	(void)params;
+
+	db = __db_open();
+	__db_exec(db, "CREATE TABLE test (n INT)");
+	__vfs_poll_and_apply(&f->vfs);
+	__db_exec(db, "INSERT INTO test(n) VALUES(1)");
+
+	rv = VfsPollCount(&f->vfs, "test.db", &n);
+	munit_assert_int(rv, ==, 0);
+	munit_assert_uint(n, >, 0);
+
+	pgnos = munit_malloc(8 * n);
+	pages = munit_malloc(512 * n);
+	rv = VfsPollInto(&f->vfs, "test.db", n, pgnos, pages);
+	munit_assert_int(rv, ==, 0);
+
+	/* Nothing is left to poll. */
+	rv = VfsPollCount(&f->vfs, "test.db", &m);
+	munit_assert_int(rv, ==, 0);
+	munit_assert_uint(m, ==, 0);
+
+	page_numbers = munit_malloc(sizeof *page_numbers * n);
+	for (i = 0; i < n; i++) {
+		uint64_t pgno;
+		memcpy(&pgno, pgnos + i * 8, sizeof pgno);
+		page_numbers[i] = (unsigned long)ByteFlipLe64(pgno);
+		munit_assert_ulong(page_numbers[i], >, 0);
+	}
+	rv = VfsApply(&f->vfs, "test.db", n, page_numbers, pages);
+	munit_assert_int(rv, ==, 0);
+
+	rv = sqlite3_prepare_v2(db, "SELECT count(*) FROM test", -1, &stmt,
+				NULL);
+	munit_assert_int(rv, ==, SQLITE_OK);
+	rv = sqlite3_step(stmt);
+	munit_assert_int(rv, ==, SQLITE_ROW);
+	munit_assert_int(sqlite3_column_int(stmt, 0), ==, 1);
+	sqlite3_finalize(stmt);
+
+	free(page_numbers);
+	free(pgnos);
+	free(pages);
+	__db_close(db);
+
+	return MUNIT_OK;
+}
+
+/* Aborting drops a committed transaction which was not polled. */
+TEST(VfsPollInto, abort, setUp, tearDown, 0, NULL)
+{
+	struct fixture *f = data;
+	sqlite3 *db;
+	unsigned n;
+	int rv;
+
+	(void)params;
+
+	db = __db_open();
+	__db_exec(db, "CREATE TABLE test (n INT)");
+
+	rv = VfsPollCount(&f->vfs, "test.db", &n);
+	munit_assert_int(rv, ==, 0);
+	munit_assert_uint(n, >, 0);
+
+	rv = VfsAbort(&f->vfs, "test.db");
+	munit_assert_int(rv, ==, 0);
+
+	rv = VfsPollCount(&f->vfs, "test.db", &n);
+	munit_assert_int(rv, ==, 0);
+	munit_assert_uint(n, ==, 0);
+
+	__db_close(db);
+
+	return MUNIT_OK;
+}
+
+/******************************************************************************
+ *
+ * VfsApplyBorrowed
+ *
+ ******************************************************************************/
+
+SUITE(VfsApplyBorrowed)
+
+static void countRelease(void *arg)
+{
+	unsigned *n = arg;
+	(*n)++;
+}
+
+/* Poll the last transaction into freshly allocated buffers. */
+static void pollInto(sqlite3_vfs *vfs,
+		     unsigned *n,
+		     uint8_t **pgnos,
+		     uint8_t **pages)
+{
+	int rv;
+
+	rv = VfsPollCount(vfs, "test.db", n);
+	munit_assert_int(rv, ==, 0);
+	munit_assert_uint(*n, >, 0);
+
+	*pgnos = munit_malloc(8 * *n);
+	*pages = munit_malloc(512 * *n);
+	rv = VfsPollInto(vfs, "test.db", *n, *pgnos, *pages);
+	munit_assert_int(rv, ==, 0);
+}
+
+/* Borrowed pages are readable right away, and handed back by the next
+ * checkpoint. */
+TEST(VfsApplyBorrowed, checkpoint, setUp, tearDown, 0, NULL)
+{
+	struct fixture *f = data;
+	sqlite3_stmt *stmt;
+	sqlite3 *db;
+	uint8_t *pgnos;
+	uint8_t *pages;
+	unsigned released = 0;
+	unsigned n;
+	int size;
+	int ckpt;
+	int rv;
+
+	(void)params;
+
+	db = __db_open();
+	__db_exec(db, "CREATE TABLE test (n INT)");
+	__vfs_poll_and_apply(&f->vfs);
+	__db_exec(db, "INSERT INTO test(n) VALUES(1)");
+	pollInto(&f->vfs, &n, &pgnos, &pages);
+
+	rv = VfsApplyBorrowed(&f->vfs, "test.db", n, pgnos, pages,
+			      countRelease, &released);
+	munit_assert_int(rv, ==, 0);
+	munit_assert_uint(released, ==, 0);
+
+	rv = sqlite3_prepare_v2(db, "SELECT n FROM test", -1, &stmt, NULL);
+	munit_assert_int(rv, ==, SQLITE_OK);
+	rv = sqlite3_step(stmt);
+	munit_assert_int(rv, ==, SQLITE_ROW);
+	munit_assert_int(sqlite3_column_int(stmt, 0), ==, 1);
+	sqlite3_finalize(stmt);
+
+	rv = sqlite3_wal_checkpoint_v2(db, "main", SQLITE_CHECKPOINT_TRUNCATE,
+				       &size, &ckpt);
+	munit_assert_int(rv, ==, 0);
+	munit_assert_uint(released, ==, 1);
+
+	/* The content is now in the database pages. */
+	memset(pages, 0, 512 * n);
+	rv = sqlite3_prepare_v2(db, "SELECT n FROM test", -1, &stmt, NULL);
+	munit_assert_int(rv, ==, SQLITE_OK);
+	rv = sqlite3_step(stmt);
+	munit_assert_int(rv, ==, SQLITE_ROW);
+	munit_assert_int(sqlite3_column_int(stmt, 0), ==, 1);
+	sqlite3_finalize(stmt);
+
+	free(pgnos);
+	free(pages);
+	__db_close(db);
+
+	return MUNIT_OK;
+}
+
+/* Borrowed pages can be replaced with private copies at any time. */
+TEST(VfsApplyBorrowed, release, setUp, tearDown, 0, NULL)
+{
+	struct fixture *f = data;
+	sqlite3_stmt *stmt;
+	sqlite3 *db;
+	uint8_t *pgnos[2];
+	uint8_t *pages[2];
+	unsigned released = 0;
+	unsigned n[2];
+	unsigned i;
+	int rv;
+
+	(void)params;
+
+	db = __db_open();
+	__db_exec(db, "CREATE TABLE test (n INT)");
+	pollInto(&f->vfs, &n[0], &pgnos[0], &pages[0]);
+	rv = VfsApplyBorrowed(&f->vfs, "test.db", n[0], pgnos[0], pages[0],
+			      countRelease, &released);
+	munit_assert_int(rv, ==, 0);
+
+	__db_exec(db, "INSERT INTO test(n) VALUES(1)");
+	pollInto(&f->vfs, &n[1], &pgnos[1], &pages[1]);
+	rv = VfsApplyBorrowed(&f->vfs, "test.db", n[1], pgnos[1], pages[1],
+			      countRelease, &released);
+	munit_assert_int(rv, ==, 0);
+
+	rv = VfsReleaseBorrowed(&f->vfs);
+	munit_assert_int(rv, ==, 0);
+	munit_assert_uint(released, ==, 2);
+
+	for (i = 0; i < 2; i++) {
+		memset(pages[i], 0, 512 * n[i]);
+		free(pgnos[i]);
+		free(pages[i]);
+	}
+
+	rv = sqlite3_prepare_v2(db, "SELECT n FROM test", -1, &stmt, NULL);
+	munit_assert_int(rv, ==, SQLITE_OK);
+	rv = sqlite3_step(stmt);
+	munit_assert_int(rv, ==, SQLITE_ROW);
+	munit_assert_int(sqlite3_column_int(stmt, 0), ==, 1);
+	sqlite3_finalize(stmt);
+
+	__db_close(db);
+
+	return MUNIT_OK;
+}
+
 /******************************************************************************
  *
  * Integration
@@ -1684,3 +2099,59 @@ TEST(VfsIntegration, checkpoint, setUp, tearDown, 0, vfs_params)
 
 	return SQLITE_OK;
 }
+
+/* After a passive checkpoint copied back all WAL frames, the next writer
+ * restarts the WAL from the beginning, dropping the old frames. */
+TEST(VfsIntegration, restart, setUp, tearDown, 0, NULL)
+{
+	struct fixture *f = data;
+	sqlite3_file *wal;
+	sqlite3_stmt *stmt;
+	sqlite3 *db;
+	sqlite_int64 size;
+	int log;
+	int ckpt;
+	int rv;
+
+	(void)params;
+
+	db = __db_open();
+	__db_exec(db, "CREATE TABLE test (n INT)");
+	__vfs_poll_and_apply(&f->vfs);
+	__db_exec(db, "INSERT INTO test(n) VALUES(1)");
+	__vfs_poll_and_apply(&f->vfs);
+
+	rv = sqlite3_wal_checkpoint_v2(db, "main", SQLITE_CHECKPOINT_PASSIVE,
+				       &log, &ckpt);
+	munit_assert_int(rv, ==, 0);
+	munit_assert_int(log, >, 1);
+	munit_assert_int(ckpt, ==, log);
+
+	/* The WAL is left in place. */
+	rv = sqlite3_file_control(db, "main", SQLITE_FCNTL_JOURNAL_POINTER,
+				  &wal);
+	munit_assert_int(rv, ==, 0);
+	rv = wal->pMethods->xFileSize(wal, &size);
+	munit_assert_int(rv, ==, 0);
+	munit_assert_int(formatWalCalcFramesNumber(512, size), ==, log);
+
+	__db_exec(db, "INSERT INTO test(n) VALUES(2)");
+	__vfs_poll_and_apply(&f->vfs);
+
+	/* Only the frames of the last transaction are left. */
+	rv = wal->pMethods->xFileSize(wal, &size);
+	munit_assert_int(rv, ==, 0);
+	munit_assert_int(formatWalCalcFramesNumber(512, size), ==, 1);
+
+	rv = sqlite3_prepare_v2(db, "SELECT sum(n) FROM test", -1, &stmt,
+				NULL);
+	munit_assert_int(rv, ==, SQLITE_OK);
+	rv = sqlite3_step(stmt);
+	munit_assert_int(rv, ==, SQLITE_ROW);
+	munit_assert_int(sqlite3_column_int(stmt, 0), ==, 3);
+	sqlite3_finalize(stmt);
+
+	__db_close(db);
+
+	return MUNIT_OK;
+}